@@ -9,13 +9,16 @@ extern "C" {
 #include <cassert>
 #include <chrono>
 #include <cstring>
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.h>
 
 using namespace std::string_view_literals;
 
 class Miner
 {
 public:
-    explicit Miner(vc::Device *device);
+    explicit Miner(std::span<vc::Device> devices);
     ~Miner();
 
     void search(std::string_view prefix);
@@ -25,12 +28,19 @@ private:
     static constexpr auto LocalSize = 256;
     static constexpr auto NonceSize = 8;
 
+    // one workgroup per LocalSize nonces, within the smallest maximum workgroup count of all devices
+    static uint64_t maxChunkSize(std::span<vc::Device> devices);
+
     int dumpResult(std::string_view prefix, uint32_t nonceIndex) const;
 
-    struct Input
+    struct PushConstants
     {
         uint32_t minLeadingZeros;
         uint32_t nonceIndexBase;
+    };
+
+    struct Input
+    {
         uint32_t prefixSize;
         uint32_t messagePrefix[16];
     };
@@ -40,29 +50,79 @@ private:
         uint32_t nonceIndex;
     };
 
-    vc::Device *m_device;
-    vc::Program m_program;
-    vc::Buffer<Input> m_inputBuffer;
-    vc::Buffer<Result> m_resultBuffer;
-    Input *m_input{nullptr};
-    Result *m_result{nullptr};
+    // two batches per device so the host can check one while the GPU works on the other
+    struct Batch
+    {
+        std::size_t resultIndex{0};
+        vc::Bindings bindings;
+        Result *result{nullptr};
+        PushConstants pushConstants{};
+    };
+
+    struct Worker
+    {
+        vc::Buffer<Input> inputBuffer;
+        Input *input{nullptr};
+        // the results of all batches, each in its own suitably aligned slice
+        vc::Buffer<Result> resultBuffer;
+        vc::Program program;
+        std::array<Batch, vc::MultiDeviceExecutor::DefaultMaxInFlight> batches;
+        std::size_t submitted{0};
+        std::size_t gathered{0};
+        std::size_t hashCount{0};
+    };
+
+    vc::MultiDeviceExecutor m_executor;
+    std::vector<Worker> m_workers;
 };
 
-Miner::Miner(vc::Device *device)
-    : m_device(device)
-    , m_program(m_device, "sha256-miner.comp.spv")
-    , m_inputBuffer(m_device)
-    , m_resultBuffer(m_device)
+Miner::Miner(std::span<vc::Device> devices)
+    : m_executor(devices, BatchSize, maxChunkSize(devices))
+{
+    m_workers.reserve(m_executor.devices().size());
+    for (auto *device : m_executor.devices())
+    {
+        auto &worker = m_workers.emplace_back();
+        worker.inputBuffer = vc::Buffer<Input>(device);
+        worker.input = worker.inputBuffer.map().data();
+        const bool useSubgroups = device->supportsSubgroupOperations(
+            VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_VOTE_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
+        // the subgroup variant can't even be loaded on devices without these operations
+        const auto *shader = useSubgroups ? "sha256-miner.comp.subgroups.spv" : "sha256-miner.comp.spv";
+        // full subgroups keep the per-subgroup reduction from running on partially populated subgroups
+        worker.program = vc::Program(device, shader, vc::SpecializationConstants{}.set(0, uint32_t{LocalSize}),
+                                     vc::SubgroupSize{.fullSubgroups = useSubgroups});
+        worker.program.enableTimestamps();
+        worker.program.enablePipelineStatistics();
+        const auto resultStride = vc::Buffer<Result>::viewAlignment(device);
+        worker.resultBuffer = vc::Buffer<Result>(device, worker.batches.size() * resultStride);
+        const auto results = worker.resultBuffer.map();
+        for (std::size_t i = 0; i < worker.batches.size(); ++i)
+        {
+            auto &batch = worker.batches[i];
+            batch.resultIndex = i * resultStride;
+            batch.bindings = worker.program.makeBindings(
+                worker.inputBuffer, vc::BufferView<Result>(worker.resultBuffer, batch.resultIndex, 1));
+            batch.result = &results[batch.resultIndex];
+        }
+    }
+}
+
+uint64_t Miner::maxChunkSize(std::span<vc::Device> devices)
 {
-    m_program.bind(m_inputBuffer, m_resultBuffer);
-    m_input = m_inputBuffer.map().data();
-    m_result = m_resultBuffer.map().data();
+    uint64_t maxGroupCount = ~uint32_t{0};
+    for (const auto &device : devices)
+        maxGroupCount = std::min<uint64_t>(maxGroupCount, device.properties().limits.maxComputeWorkGroupCount[0]);
+    return maxGroupCount * LocalSize;
 }
 
 Miner::~Miner()
 {
-    m_inputBuffer.unmap();
-    m_resultBuffer.unmap();
+    for (auto &worker : m_workers)
+    {
+        worker.inputBuffer.unmap();
+        worker.resultBuffer.unmap();
+    }
 }
 
 void Miner::search(std::string_view prefix)
@@ -78,34 +138,40 @@ void Miner::search(std::string_view prefix)
     for (std::size_t i = 0; i < 14; ++i)
         message[i] = __builtin_bswap32(message[i]);
     message[15] = messageSize * 8;
-    std::ranges::copy(message, m_input->messagePrefix);
-    m_input->prefixSize = prefix.size();
+    for (auto &worker : m_workers)
+    {
+        std::ranges::copy(message, worker.input->messagePrefix);
+        worker.input->prefixSize = prefix.size();
+        worker.hashCount = 0;
+        worker.program.resetStats();
+    }
 
     const auto timeStart = std::chrono::steady_clock::now();
 
     std::size_t hashCount = 0;
-    uint32_t nonceIndexBase = 0;
     uint32_t minLeadingZeros = 16;
-    for (uint64_t i = 0; i < (uint64_t(1) << 32) / BatchSize; ++i)
-    {
-        m_input->minLeadingZeros = minLeadingZeros;
-        m_input->nonceIndexBase = nonceIndexBase;
 
-        m_result->nonceIndex = ~0u;
-
-        const auto groupCount = (BatchSize + LocalSize - 1) / LocalSize;
-        m_program.dispatch(groupCount, 1, 1);
-        hashCount += groupCount * LocalSize;
-
-        if (m_result->nonceIndex != ~0u)
+    // the executor keeps at most one chunk in flight per batch, and retires them in order
+    const auto submit = [&](std::size_t device, uint64_t offset, uint64_t count) {
+        auto &worker = m_workers[device];
+        auto &batch = worker.batches[worker.submitted++ % worker.batches.size()];
+        batch.pushConstants = {.minLeadingZeros = minLeadingZeros, .nonceIndexBase = static_cast<uint32_t>(offset)};
+        batch.result->nonceIndex = ~0u;
+        return worker.program.dispatchAsync(batch.bindings, batch.pushConstants, count / LocalSize, 1, 1);
+    };
+    const auto gather = [&](std::size_t device, uint64_t, uint64_t count) {
+        auto &worker = m_workers[device];
+        auto &batch = worker.batches[worker.gathered++ % worker.batches.size()];
+        if (batch.result->nonceIndex != ~0u)
         {
-            int leadingZeros = dumpResult(prefix, m_result->nonceIndex);
-            assert(leadingZeros >= minLeadingZeros);
-            minLeadingZeros = leadingZeros + 1;
+            int leadingZeros = dumpResult(prefix, batch.result->nonceIndex);
+            assert(leadingZeros >= batch.pushConstants.minLeadingZeros);
+            minLeadingZeros = std::max<uint32_t>(minLeadingZeros, leadingZeros + 1);
         }
-
-        nonceIndexBase += BatchSize;
-    }
+        worker.hashCount += count;
+        hashCount += count;
+    };
+    m_executor.run(uint64_t(1) << 32, submit, gather);
 
     const auto timeEnd = std::chrono::steady_clock::now();
     const auto elapsed = timeEnd - timeStart;
@@ -113,6 +179,17 @@ void Miner::search(std::string_view prefix)
                               std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / 1000000;
     std::printf("%lu hashes, %lu ms (%.2f Mhashes/sec)\n", hashCount,
                 std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), hashesPerSec);
+    for (std::size_t device = 0; device < m_workers.size(); ++device)
+    {
+        const auto &worker = m_workers[device];
+        const auto stats = worker.program.stats();
+        std::printf("  %s: %.2f Mhashes/sec, %lu dispatches, %.3f ms GPU time per dispatch\n",
+                    m_executor.devices()[device]->properties().deviceName, m_executor.throughput()[device] / 1000000,
+                    stats.timedDispatches, stats.averageNanoseconds() / 1000000);
+        // every invocation computes one hash, anything above the hash count is wasted work
+        if (stats.countedDispatches > 0)
+            std::printf("    %lu invocations for %lu hashes\n", stats.totalInvocations, worker.hashCount);
+    }
 }
 
 int Miner::dumpResult(std::string_view prefix, uint32_t nonceIndex) const
@@ -161,10 +238,10 @@ int Miner::dumpResult(std::string_view prefix, uint32_t nonceIndex) const
 int main()
 {
     vc::Instance instance;
-    auto device = std::move(instance.devices().at(1));
+    auto devices = instance.devices();
 
     const std::string_view prefix = "hello/";
 
-    Miner miner(&device);
+    Miner miner(devices);
     miner.search(prefix);
 }
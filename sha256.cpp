@@ -3,6 +3,7 @@ import vc;
 #include <array>
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <span>
 #include <string_view>
@@ -24,7 +25,13 @@ std::array<uint8_t, 32> sha256(std::string_view message)
                                            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
 
     vc::Instance instance;
-    auto device = std::move(instance.devices().at(0));
+    const auto physicalDevice = instance.selectBestDevice();
+    if (!physicalDevice.has_value())
+    {
+        std::fprintf(stderr, "No Vulkan device with compute support\n");
+        std::exit(EXIT_FAILURE);
+    }
+    vc::Device device(&instance, physicalDevice->handle);
 
     vc::Buffer<uint32_t> dataBuffer(&device, data);
     vc::Buffer<uint32_t> stateBuffer(&device, state);
@@ -4,16 +4,36 @@ import vc;
 #include <renderdoc_app.h>
 #endif
 
+#include <array>
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
 #include <dlfcn.h>
 #include <numeric>
 #include <span>
+#include <vulkan/vulkan.h>
 
 int main()
 {
-    vc::Instance instance;
-    auto device = std::move(instance.devices().at(0));
+#ifndef NDEBUG
+    // the kernel's debugPrintfEXT output goes through the validation layer, reported as info messages
+    vc::Instance instance({.applicationName = "simple",
+                           .layers = {"VK_LAYER_KHRONOS_validation"},
+                           .debugMessenger = true,
+                           .debugMessageSeverities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT |
+                                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                                                     VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+                           .debugPrintf = true});
+#else
+    vc::Instance instance({.applicationName = "simple"});
+#endif
+    const auto physicalDevice = instance.selectBestDevice();
+    if (!physicalDevice.has_value())
+    {
+        std::fprintf(stderr, "No Vulkan device with compute support\n");
+        std::exit(EXIT_FAILURE);
+    }
+    vc::Device device(&instance, physicalDevice->handle);
 
 #ifdef USE_RENDERDOC
     RENDERDOC_API_1_1_2 *renderDoc = nullptr;
@@ -30,25 +50,22 @@ int main()
 
     constexpr auto Size = 32;
 
-    vc::Buffer<float> inBuffer(&device, Size);
-    {
-        auto values = inBuffer.map();
-        std::iota(values.begin(), values.end(), 1);
-        inBuffer.unmap();
-    }
-    vc::Buffer<float> outBuffer(&device, Size);
+    std::array<float, Size> inValues;
+    std::iota(inValues.begin(), inValues.end(), 1);
+    vc::Buffer<float> inBuffer(&device, inValues, vc::MemoryUsage::DeviceLocal);
+    vc::Buffer<float> outBuffer(&device, Size, vc::MemoryUsage::DeviceLocal);
+
+    constexpr auto ThreadCount = 16;
 
-    vc::Program program(&device, "simple.comp.spv");
+    vc::Program program(&device, "simple.comp.spv", vc::SpecializationConstants{}.set(0, uint32_t{ThreadCount}));
     program.bind(inBuffer, outBuffer);
 
-    constexpr auto ThreadCount = 16;
     constexpr auto BlockCount = (Size + ThreadCount - 1) / ThreadCount;
     program.dispatch(BlockCount, 1, 1);
     {
-        const auto values = outBuffer.map();
+        const auto values = outBuffer.download();
         for (std::size_t i = 0; i < Size; ++i)
             std::printf("%lu: %f\n", i, values[i]);
-        outBuffer.unmap();
     }
 
 #ifdef USE_RENDERDOC
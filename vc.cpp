@@ -1,18 +1,28 @@
 module;
 
 #include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
 #include <concepts>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <functional>
 #include <memory>
+#include <numeric>
 #include <optional>
+#include <set>
 #include <span>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include <unistd.h>
 #include <vulkan/vulkan.h>
 
 export module vc;
@@ -20,11 +30,191 @@ export module vc;
 export namespace vc
 {
 class Device;
+class Queue;
+
+struct Allocation
+{
+    VkDeviceMemory memory{VK_NULL_HANDLE};
+    VkDeviceSize offset{0};
+    VkDeviceSize size{0};
+    std::byte *mapped{nullptr};
+    std::uint32_t memoryTypeIndex{~0u};
+    std::uint32_t blockIndex{~0u};
+};
+
+// Sub-allocates buffer memory out of large per-memory-type blocks using a buddy scheme, so that creating a buffer
+// doesn't need a vkAllocateMemory call in the common case. Host-visible blocks stay persistently mapped.
+class MemoryAllocator
+{
+public:
+    MemoryAllocator(VkPhysicalDevice physDevice, VkDevice device, VkMemoryAllocateFlags allocateFlags = 0,
+                    bool externalMemoryHost = false);
+    ~MemoryAllocator();
+
+    MemoryAllocator(const MemoryAllocator &) = delete;
+    MemoryAllocator &operator=(const MemoryAllocator &) = delete;
+
+    std::optional<Allocation> allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties);
+    void free(const Allocation &allocation);
+    // Wraps host memory in a dedicated allocation without copying it. Needs VK_EXT_external_memory_host; pointer and
+    // size must be aligned to minImportedHostPointerAlignment.
+    std::optional<Allocation> importHostMemory(void *pointer, VkDeviceSize size, std::uint32_t typeBits);
+
+    std::uint32_t findMemoryType(std::uint32_t typeBits, VkMemoryPropertyFlags properties, VkDeviceSize size) const;
+    VkMemoryPropertyFlags memoryPropertyFlags(std::uint32_t memoryTypeIndex) const
+    {
+        return m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    }
+
+private:
+    static constexpr VkDeviceSize DefaultBlockSize = VkDeviceSize(64) << 20;
+    static constexpr std::uint32_t MinOrder = 8; // 256 bytes
+
+    struct Block
+    {
+        VkDeviceMemory memory{VK_NULL_HANDLE};
+        std::byte *mapped{nullptr};
+        std::vector<std::set<VkDeviceSize>> freeLists; // indexed by order
+        std::size_t allocationCount{0};
+    };
+
+    struct Pool
+    {
+        std::uint32_t maxOrder{0};
+        std::vector<Block> blocks;
+    };
+
+    std::optional<Allocation> allocateDedicated(VkDeviceSize size, std::uint32_t memoryTypeIndex);
+    bool initBlock(Block &block, std::uint32_t memoryTypeIndex, std::uint32_t maxOrder);
+    void releaseBlock(Block &block);
+
+    VkDevice m_device{VK_NULL_HANDLE};
+    VkMemoryAllocateFlags m_allocateFlags{0};
+    PFN_vkGetMemoryHostPointerPropertiesEXT m_getMemoryHostPointerProperties{nullptr};
+    VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+    std::vector<Pool> m_pools; // indexed by memory type
+};
+
+// Handle to a submission in flight. Tickets are cheap to copy and stay valid after the submission's command buffer
+// has been recycled.
+class Ticket
+{
+public:
+    Ticket() = default;
+    Ticket(const Queue *queue, std::uint64_t serial)
+        : m_queue(queue)
+        , m_serial(serial)
+    {
+    }
+
+    explicit operator bool() const { return m_queue != nullptr; }
+
+    bool isReady() const;
+    void wait() const;
+    // false if the submission hasn't completed within the timeout
+    bool wait(std::chrono::nanoseconds timeout) const;
+
+private:
+    friend class Queue;
+
+    const Queue *m_queue{nullptr};
+    std::uint64_t m_serial{0};
+};
+
+struct StagingBuffer
+{
+    VkBuffer buffer{VK_NULL_HANDLE};
+    VkDeviceSize size{0};
+    Allocation allocation;
+};
+
+// Recycles host-visible buffers used to move data in and out of device-local memory. A buffer released with a ticket
+// is only handed out again once that submission has completed. Buffers are at most MaxBufferSize, so larger transfers
+// go through them in chunks, and the pool keeps at most MaxPoolSize of them around.
+class StagingPool
+{
+public:
+    static constexpr VkDeviceSize MaxBufferSize = VkDeviceSize(64) << 20;
+
+    StagingPool(VkDevice device, MemoryAllocator *allocator, std::vector<std::uint32_t> queueFamilyIndices);
+    ~StagingPool();
+
+    StagingPool(const StagingPool &) = delete;
+    StagingPool &operator=(const StagingPool &) = delete;
+
+    // The buffer is smaller than size if size is over MaxBufferSize. Waits for a pending buffer rather than growing
+    // the pool beyond MaxPoolSize.
+    StagingBuffer acquire(VkDeviceSize size);
+    void release(StagingBuffer buffer, Ticket ticket = {});
+
+private:
+    static constexpr VkDeviceSize MinBufferSize = VkDeviceSize(64) << 10;
+    static constexpr VkDeviceSize MaxPoolSize = 4 * MaxBufferSize;
+
+    StagingBuffer create(VkDeviceSize size);
+    void destroy(const StagingBuffer &buffer);
+
+    VkDevice m_device{VK_NULL_HANDLE};
+    MemoryAllocator *m_allocator{nullptr};
+    std::vector<std::uint32_t> m_queueFamilyIndices;
+    std::vector<StagingBuffer> m_freeBuffers;
+    std::vector<std::pair<StagingBuffer, Ticket>> m_pendingBuffers; // in submission order
+    VkDeviceSize m_poolSize{0}; // all buffers, including those handed out
+};
+
+enum class MemoryUsage
+{
+    HostVisible,
+    DeviceLocal,
+};
+
+// Selects the Buffer constructor that wraps existing host memory.
+struct ImportHostMemory
+{
+};
+
+// What is known about a physical device without creating a logical device for it.
+struct PhysicalDevice
+{
+    VkPhysicalDevice handle{VK_NULL_HANDLE};
+    VkPhysicalDeviceProperties properties{};
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    std::vector<VkQueueFamilyProperties> queueFamilies;
+
+    bool hasCompute() const;
+    VkDeviceSize deviceLocalMemory() const;
+};
+
+struct DeviceCriteria
+{
+    std::uint32_t minApiVersion{VK_API_VERSION_1_0};
+    VkDeviceSize minDeviceLocalMemory{0};
+    // rank integrated GPUs first, e.g. to save power on laptops
+    bool preferIntegrated{false};
+    // extra requirements, devices for which this returns false are skipped
+    std::function<bool(const PhysicalDevice &)> filter;
+};
+
+struct InstanceOptions
+{
+    std::string applicationName{"vc"};
+    std::uint32_t applicationVersion{0};
+    // e.g. VK_LAYER_KHRONOS_validation for debug builds, none by default
+    std::vector<std::string> layers;
+    std::vector<std::string> extensions;
+    // Prints the messages of the layers to stderr. Enables VK_EXT_debug_utils.
+    bool debugMessenger{false};
+    VkDebugUtilsMessageSeverityFlagsEXT debugMessageSeverities{VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                                                               VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT};
+    // Has the validation layer report debugPrintfEXT output from shaders as info messages. Needs
+    // VK_LAYER_KHRONOS_validation in layers. Enables VK_EXT_validation_features.
+    bool debugPrintf{false};
+};
 
 class Instance
 {
 public:
-    Instance();
+    explicit Instance(const InstanceOptions &options = {});
     ~Instance();
 
     Instance(const Instance &) = delete;
@@ -33,14 +223,86 @@ public:
     Instance &operator=(const Instance &) = delete;
     Instance &operator=(Instance &&rhs);
 
-    friend inline void swap(Instance &lhs, Instance &rhs) { std::swap(lhs.m_instance, rhs.m_instance); }
+    friend inline void swap(Instance &lhs, Instance &rhs)
+    {
+        using std::swap;
+        swap(lhs.m_instance, rhs.m_instance);
+        swap(lhs.m_debugMessenger, rhs.m_debugMessenger);
+    }
 
     operator VkInstance() const { return m_instance; }
 
+    // Creates a logical device for every physical device.
     std::vector<Device> devices() const;
 
+    std::vector<PhysicalDevice> physicalDevices() const;
+    // The usable device that best matches the criteria, preferring discrete GPUs and then more device-local memory.
+    std::optional<PhysicalDevice> selectBestDevice(const DeviceCriteria &criteria = {}) const;
+
 private:
     VkInstance m_instance{VK_NULL_HANDLE};
+    VkDebugUtilsMessengerEXT m_debugMessenger{VK_NULL_HANDLE};
+};
+
+// A device queue with a ring of command buffers, so that several submissions can be in flight at once. Slots are
+// recycled in order; submitting into a slot that is still in flight waits for it first.
+//
+// With timeline semaphores, each submission also signals the queue's timeline with its serial, so that submissions
+// on other queues can wait for it on the device.
+class Queue
+{
+public:
+    static constexpr std::uint32_t DefaultRingSize = 8;
+
+    Queue(VkDevice device, std::uint32_t familyIndex, bool timelineSemaphore,
+          std::uint32_t ringSize = DefaultRingSize);
+    ~Queue();
+
+    Queue(const Queue &) = delete;
+    Queue &operator=(const Queue &) = delete;
+
+    operator VkQueue() const { return m_queue; }
+
+    std::uint32_t familyIndex() const { return m_familyIndex; }
+    VkCommandPool commandPool() const { return m_commandPool; }
+
+    Ticket submit(const std::function<void(VkCommandBuffer)> &record);
+    Ticket submit(VkCommandBuffer commandBuffer);
+
+    // Makes the next submission on this queue wait on the device for a submission on another queue.
+    void addWait(const Ticket &ticket);
+
+    // Submissions on a queue complete in order, so this covers every earlier one too. Empty if there were none.
+    Ticket lastSubmission() const { return m_nextSerial > 1 ? Ticket(this, m_nextSerial - 1) : Ticket(); }
+
+    bool isComplete(std::uint64_t serial) const;
+    void wait(std::uint64_t serial) const;
+    bool wait(std::uint64_t serial, std::chrono::nanoseconds timeout) const;
+    void waitIdle() const;
+
+private:
+    struct Slot
+    {
+        VkCommandBuffer commandBuffer{VK_NULL_HANDLE};
+        VkFence fence{VK_NULL_HANDLE};
+        std::uint64_t serial{0};
+    };
+
+    const Slot &slot(std::uint64_t serial) const { return m_slots[(serial - 1) % m_slots.size()]; }
+    Slot &slot(std::uint64_t serial) { return m_slots[(serial - 1) % m_slots.size()]; }
+
+    std::uint64_t acquireSlot();
+    Ticket submitSlot(std::uint64_t serial, VkCommandBuffer commandBuffer);
+
+    VkDevice m_device{VK_NULL_HANDLE};
+    std::uint32_t m_familyIndex{~0u};
+    VkQueue m_queue{VK_NULL_HANDLE};
+    VkCommandPool m_commandPool{VK_NULL_HANDLE};
+    VkSemaphore m_timeline{VK_NULL_HANDLE};
+    std::vector<Slot> m_slots;
+    std::uint64_t m_nextSerial{1};
+    std::vector<VkSemaphore> m_waitSemaphores;
+    std::vector<std::uint64_t> m_waitValues;
 };
 
 class Device
@@ -61,30 +323,97 @@ public:
         using std::swap;
         swap(lhs.m_instance, rhs.m_instance);
         swap(lhs.m_physDevice, rhs.m_physDevice);
+        swap(lhs.m_properties, rhs.m_properties);
+        swap(lhs.m_subgroupProperties, rhs.m_subgroupProperties);
+        swap(lhs.m_subgroupSizeControlProperties, rhs.m_subgroupSizeControlProperties);
         swap(lhs.m_queueFamilyIndex, rhs.m_queueFamilyIndex);
+        swap(lhs.m_transferQueueFamilyIndex, rhs.m_transferQueueFamilyIndex);
+        swap(lhs.m_timestampValidBits, rhs.m_timestampValidBits);
         swap(lhs.m_device, rhs.m_device);
-        swap(lhs.m_commandPool, rhs.m_commandPool);
-        swap(lhs.m_commandBuffer, rhs.m_commandBuffer);
+        swap(lhs.m_pipelineCache, rhs.m_pipelineCache);
+        swap(lhs.m_bufferDeviceAddress, rhs.m_bufferDeviceAddress);
+        swap(lhs.m_pipelineStatistics, rhs.m_pipelineStatistics);
+        swap(lhs.m_subgroupSizeControl, rhs.m_subgroupSizeControl);
+        swap(lhs.m_computeFullSubgroups, rhs.m_computeFullSubgroups);
+        swap(lhs.m_synchronization2, rhs.m_synchronization2);
+        swap(lhs.m_maxPushDescriptors, rhs.m_maxPushDescriptors);
+        swap(lhs.m_cmdPushDescriptorSet, rhs.m_cmdPushDescriptorSet);
+        swap(lhs.m_minImportedHostPointerAlignment, rhs.m_minImportedHostPointerAlignment);
         swap(lhs.m_computeQueue, rhs.m_computeQueue);
+        swap(lhs.m_transferQueue, rhs.m_transferQueue);
+        swap(lhs.m_allocator, rhs.m_allocator);
+        swap(lhs.m_stagingPool, rhs.m_stagingPool);
     }
 
     operator VkDevice() const { return m_device; }
 
+    const VkPhysicalDeviceProperties &properties() const { return m_properties; }
+    const VkPhysicalDeviceSubgroupProperties &subgroupProperties() const { return m_subgroupProperties; }
+    // whether compute shaders can use all of the given subgroup operations
+    bool supportsSubgroupOperations(VkSubgroupFeatureFlags operations) const;
+    const VkPhysicalDeviceSubgroupSizeControlProperties &subgroupSizeControlProperties() const
+    {
+        return m_subgroupSizeControlProperties;
+    }
     std::uint32_t computeQueueFamilyIndex() const { return m_queueFamilyIndex; }
-    VkCommandPool commandPool() const { return m_commandPool; }
-    VkCommandBuffer commandBuffer() const { return m_commandBuffer; }
-    VkQueue computeQueue() const { return m_computeQueue; }
+    // zero when the compute queue doesn't support timestamps
+    std::uint32_t timestampValidBits() const { return m_timestampValidBits; }
+    // the families that buffers are shared between, the compute family first
+    std::vector<std::uint32_t> queueFamilyIndices() const;
+    VkPipelineCache pipelineCache() const { return m_pipelineCache; }
+    Queue *computeQueue() const { return m_computeQueue.get(); }
+    // a queue from a transfer-only family if the device has one, otherwise the compute queue
+    Queue *transferQueue() const { return m_transferQueue ? m_transferQueue.get() : m_computeQueue.get(); }
+    MemoryAllocator *allocator() const { return m_allocator.get(); }
+    StagingPool *stagingPool() const { return m_stagingPool.get(); }
+    bool hasBufferDeviceAddress() const { return m_bufferDeviceAddress; }
+    bool hasPipelineStatistics() const { return m_pipelineStatistics; }
+    // whether compute pipelines can require a subgroup size
+    bool hasSubgroupSizeControl() const { return m_subgroupSizeControl; }
+    bool hasComputeFullSubgroups() const { return m_computeFullSubgroups; }
+    // whether vkCmdPipelineBarrier2 can be used
+    bool hasSynchronization2() const { return m_synchronization2; }
+    // zero when VK_KHR_push_descriptor is not supported
+    std::uint32_t maxPushDescriptors() const { return m_maxPushDescriptors; }
+    // zero when host memory can't be imported, see Buffer's ImportHostMemory constructor
+    VkDeviceSize minImportedHostPointerAlignment() const { return m_minImportedHostPointerAlignment; }
 
     std::uint32_t findHostVisibleMemory(VkDeviceSize size) const;
 
+    void execute(const std::function<void(VkCommandBuffer)> &record) const;
+    Ticket submit(const std::function<void(VkCommandBuffer)> &record) const;
+
+    void pushDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout,
+                           std::span<const VkWriteDescriptorSet> writeDescriptorSets) const;
+
+    void savePipelineCache() const;
+
 private:
+    std::filesystem::path pipelineCachePath() const;
+    void initPipelineCache();
+
     const Instance *m_instance{nullptr};
     VkPhysicalDevice m_physDevice{VK_NULL_HANDLE};
+    VkPhysicalDeviceProperties m_properties{};
+    VkPhysicalDeviceSubgroupProperties m_subgroupProperties{};
+    VkPhysicalDeviceSubgroupSizeControlProperties m_subgroupSizeControlProperties{};
     std::uint32_t m_queueFamilyIndex{~0u};
+    std::uint32_t m_transferQueueFamilyIndex{~0u};
+    std::uint32_t m_timestampValidBits{0};
     VkDevice m_device{VK_NULL_HANDLE};
-    VkCommandPool m_commandPool{VK_NULL_HANDLE};
-    VkCommandBuffer m_commandBuffer{VK_NULL_HANDLE};
-    VkQueue m_computeQueue{VK_NULL_HANDLE};
+    VkPipelineCache m_pipelineCache{VK_NULL_HANDLE};
+    bool m_bufferDeviceAddress{false};
+    bool m_pipelineStatistics{false};
+    bool m_subgroupSizeControl{false};
+    bool m_computeFullSubgroups{false};
+    bool m_synchronization2{false};
+    std::uint32_t m_maxPushDescriptors{0};
+    PFN_vkCmdPushDescriptorSetKHR m_cmdPushDescriptorSet{nullptr};
+    VkDeviceSize m_minImportedHostPointerAlignment{0};
+    std::unique_ptr<Queue> m_computeQueue;
+    std::unique_ptr<Queue> m_transferQueue;
+    std::unique_ptr<MemoryAllocator> m_allocator;
+    std::unique_ptr<StagingPool> m_stagingPool;
 };
 
 template<typename T>
@@ -92,8 +421,13 @@ class Buffer
 {
 public:
     Buffer() = default;
-    Buffer(const Device *device, std::size_t size = 1);
-    Buffer(const Device *device, std::span<const T> data);
+    Buffer(const Device *device, std::size_t size = 1, MemoryUsage usage = MemoryUsage::HostVisible);
+    Buffer(const Device *device, std::span<const T> data, MemoryUsage usage = MemoryUsage::HostVisible);
+    // Uses data as the buffer memory, without copying, when the device supports VK_EXT_external_memory_host and both
+    // the address and the size of data are multiples of Device::minImportedHostPointerAlignment(). Otherwise the data
+    // is copied into a new host-visible buffer. When imported, data must outlive the buffer and writes on either side
+    // are seen by the other.
+    Buffer(const Device *device, std::span<T> data, ImportHostMemory);
     ~Buffer();
 
     Buffer(const Buffer &) = delete;
@@ -107,27 +441,199 @@ public:
         using std::swap;
         swap(lhs.m_device, rhs.m_device);
         swap(lhs.m_sizeInBytes, rhs.m_sizeInBytes);
-        swap(lhs.m_deviceMemory, rhs.m_deviceMemory);
+        swap(lhs.m_allocation, rhs.m_allocation);
         swap(lhs.m_buffer, rhs.m_buffer);
+        swap(lhs.m_hostImported, rhs.m_hostImported);
     }
 
     operator VkBuffer() const { return m_buffer; }
 
+    std::size_t size() const { return m_sizeInBytes / sizeof(T); }
+    // whether the buffer aliases host memory passed with ImportHostMemory
+    bool isHostImported() const { return m_hostImported; }
+
+    // Empty unless the buffer is in host-coherent memory, which is always the case for MemoryUsage::HostVisible.
     std::span<T> map() const;
     void unmap() const;
 
+    void upload(std::span<const T> data) const;
+    // Copies on the transfer queue, after the work already submitted on the compute queue and earlier uploads. The
+    // next submission on the compute queue waits for the copy to finish.
+    Ticket uploadAsync(std::span<const T> data) const;
+    std::vector<T> download() const;
+
+    // GPU-side transfers, recorded on the compute queue and ordered against the dispatches submitted before and after
+    // them. Offsets and counts are in elements; WholeSize means up to the end of the buffer.
+    static constexpr std::size_t WholeSize = ~std::size_t{0};
+
+    // Sets every 32-bit word of the range to value. The range must start and end on 4-byte boundaries, except that a
+    // range up to the end of the buffer stops at its last whole word.
+    void fill(std::uint32_t value, std::size_t offset = 0, std::size_t count = WholeSize) const;
+    Ticket fillAsync(std::uint32_t value, std::size_t offset = 0, std::size_t count = WholeSize) const;
+    void copyTo(const Buffer &destination, std::size_t sourceOffset = 0, std::size_t destinationOffset = 0,
+                std::size_t count = WholeSize) const;
+    Ticket copyToAsync(const Buffer &destination, std::size_t sourceOffset = 0, std::size_t destinationOffset = 0,
+                       std::size_t count = WholeSize) const;
+    // The data goes in the command buffer, so it is limited to MaxUpdateSize bytes, and offset and size must be
+    // multiples of 4 bytes.
+    static constexpr VkDeviceSize MaxUpdateSize = 65536;
+    void update(std::span<const T> data, std::size_t offset = 0) const;
+    Ticket updateAsync(std::span<const T> data, std::size_t offset = 0) const;
+
+    // Only valid if the device has buffer device addresses. Can be passed to a kernel through push constants.
+    VkDeviceAddress deviceAddress() const;
+
+    // The element offsets a BufferView can start at on the device are multiples of this.
+    static std::size_t viewAlignment(const Device *device);
+
 private:
+    friend class Sequence;
+    template<typename>
+    friend class BufferView;
+
+    void initBuffer(const void *next);
+    // whether the host can access the memory directly, without flushes or invalidates
+    bool isHostCoherent() const;
+    // the byte range of count elements at offset, clamped to the buffer
+    VkDeviceSize byteCount(std::size_t offset, std::size_t count) const;
+    // the byte ranges for fill() and update(), which exit on ranges that break their alignment or size limits
+    VkDeviceSize fillRange(std::size_t offset, std::size_t count) const;
+    VkDeviceSize updateRange(std::size_t offset, std::size_t count) const;
+    Ticket submitTransfer(const std::function<void(VkCommandBuffer)> &record) const;
+
     const Device *m_device{nullptr};
     VkDeviceSize m_sizeInBytes{0};
-    VkDeviceMemory m_deviceMemory{VK_NULL_HANDLE};
+    Allocation m_allocation;
+    VkBuffer m_buffer{VK_NULL_HANDLE};
+    bool m_hostImported{false};
+};
+
+// A range of elements of a Buffer, so that slices of one allocation can be bound to different kernels or batches. Can
+// be passed to Program::bind() and Program::makeBindings() in place of the whole buffer. Must not outlive the buffer.
+template<typename T>
+class BufferView
+{
+public:
+    BufferView() = default;
+    // offset must be a multiple of Buffer<T>::viewAlignment(), and the clamped range must not be empty
+    BufferView(const Buffer<T> &buffer, std::size_t offset, std::size_t count = Buffer<T>::WholeSize);
+
+    operator VkBuffer() const { return m_buffer; }
+
+    std::size_t offset() const { return m_offset; }
+    std::size_t size() const { return m_count; }
+
+    VkDescriptorBufferInfo descriptorInfo() const
+    {
+        return {.buffer = m_buffer, .offset = m_offset * sizeof(T), .range = m_count * sizeof(T)};
+    }
+
+private:
     VkBuffer m_buffer{VK_NULL_HANDLE};
+    std::size_t m_offset{0};
+    std::size_t m_count{0};
+};
+
+// Push constant space every implementation is required to provide.
+inline constexpr std::uint32_t MaxPushConstantsSize = 128;
+
+// vkCmdPushConstants takes whole 32-bit words
+template<typename T>
+concept PushConstantData = std::is_class_v<T> && std::is_trivially_copyable_v<T> && sizeof(T) <= MaxPushConstantsSize &&
+                           sizeof(T) % 4 == 0;
+
+// Values for a shader's specialization constants (`layout (constant_id = N) const ...`), applied when the pipeline is
+// created. Booleans are stored as VkBool32.
+class SpecializationConstants
+{
+public:
+    template<typename T>
+        requires std::is_arithmetic_v<T>
+    SpecializationConstants &set(std::uint32_t id, T value);
+
+    bool empty() const { return m_entries.empty(); }
+    VkSpecializationInfo info() const;
+    // the raw bits of a 32-bit constant, if it was set
+    std::optional<std::uint32_t> get(std::uint32_t id) const;
+
+private:
+    std::vector<VkSpecializationMapEntry> m_entries;
+    std::vector<std::byte> m_data;
+};
+
+// The buffers bound to a Program for a dispatch, so that several dispatches of the same kernel can be in flight with
+// different buffers. Must not outlive the Program it was made from.
+class Bindings
+{
+public:
+    Bindings() = default;
+    ~Bindings();
+
+    Bindings(const Bindings &) = delete;
+    Bindings(Bindings &&rhs);
+
+    Bindings &operator=(const Bindings &) = delete;
+    Bindings &operator=(Bindings &&rhs);
+
+    friend inline void swap(Bindings &lhs, Bindings &rhs)
+    {
+        using std::swap;
+        swap(lhs.m_device, rhs.m_device);
+        swap(lhs.m_descriptorPool, rhs.m_descriptorPool);
+        swap(lhs.m_descriptorSet, rhs.m_descriptorSet);
+        swap(lhs.m_bufferInfos, rhs.m_bufferInfos);
+    }
+
+private:
+    friend class Program;
+
+    const Device *m_device{nullptr};
+    VkDescriptorPool m_descriptorPool{VK_NULL_HANDLE};
+    VkDescriptorSet m_descriptorSet{VK_NULL_HANDLE};
+    // only used when the program pushes its descriptors
+    std::vector<VkDescriptorBufferInfo> m_bufferInfos;
+};
+
+// GPU-side measurements of the dispatches of a Program, see Program::enableTimestamps() and
+// Program::enablePipelineStatistics().
+struct ProgramStats
+{
+    std::uint64_t timedDispatches{0};
+    double totalNanoseconds{0.0};
+    double minNanoseconds{0.0};
+    double maxNanoseconds{0.0};
+
+    std::uint64_t countedDispatches{0};
+    std::uint64_t totalInvocations{0};
+    std::uint64_t minInvocations{0};
+    std::uint64_t maxInvocations{0};
+
+    double averageNanoseconds() const { return timedDispatches ? totalNanoseconds / timedDispatches : 0.0; }
+    double averageInvocations() const
+    {
+        return countedDispatches ? static_cast<double>(totalInvocations) / countedDispatches : 0.0;
+    }
+};
+
+// Subgroup size requirements of a Program. Requirements the device doesn't support (see
+// Device::hasSubgroupSizeControl() and Device::hasComputeFullSubgroups()) or can't meet are ignored: a required size
+// outside [minSubgroupSize, maxSubgroupSize] or that would split the workgroup into more than
+// maxComputeWorkgroupSubgroups subgroups, or full subgroups with a local_size_x that isn't a multiple of the subgroup
+// size.
+struct SubgroupSize
+{
+    // a power of two between minSubgroupSize and maxSubgroupSize, zero to leave it to the driver
+    std::uint32_t required{0};
+    // all invocations of a subgroup are active, local_size_x must be a multiple of the subgroup size
+    bool fullSubgroups{false};
 };
 
 class Program
 {
 public:
     Program() = default;
-    Program(const Device *device, const std::string &path);
+    Program(const Device *device, const std::string &path, SpecializationConstants specializationConstants = {},
+            SubgroupSize subgroupSize = {});
     ~Program();
 
     Program(const Program &) = delete;
@@ -141,31 +647,326 @@ public:
         using std::swap;
         swap(lhs.m_device, rhs.m_device);
         swap(lhs.m_shaderModule, rhs.m_shaderModule);
+        swap(lhs.m_specializationConstants, rhs.m_specializationConstants);
+        swap(lhs.m_subgroupSize, rhs.m_subgroupSize);
+        swap(lhs.m_localSize, rhs.m_localSize);
+        swap(lhs.m_bindingCount, rhs.m_bindingCount);
         swap(lhs.m_descriptorSetLayout, rhs.m_descriptorSetLayout);
         swap(lhs.m_pipelineLayout, rhs.m_pipelineLayout);
         swap(lhs.m_pipeline, rhs.m_pipeline);
-        swap(lhs.m_descriptorPool, rhs.m_descriptorPool);
-        swap(lhs.m_descriptorSet, rhs.m_descriptorSet);
+        swap(lhs.m_pushDescriptors, rhs.m_pushDescriptors);
+        swap(lhs.m_descriptorPools, rhs.m_descriptorPools);
+        swap(lhs.m_bindings, rhs.m_bindings);
+        swap(lhs.m_retiredBindings, rhs.m_retiredBindings);
+        swap(lhs.m_queries, rhs.m_queries);
     }
 
+    // Rebinding doesn't affect pending dispatches, which keep the buffers they were submitted with. A Sequence
+    // recorded with the previous bindings must be recorded again. Kernels that only take buffer device addresses
+    // through push constants are bound with no buffers at all.
     template<std::convertible_to<VkBuffer>... Buffers>
     void bind(const Buffers &...buffers);
 
+    // All bindings of a program share its descriptor set layout and must bind the same number of buffers.
+    template<std::convertible_to<VkBuffer>... Buffers>
+    Bindings makeBindings(const Buffers &...buffers);
+
     void dispatch(uint32_t groupCountX = 1, uint32_t groupCountY = 1, uint32_t groupCountZ = 1) const;
+    Ticket dispatchAsync(uint32_t groupCountX = 1, uint32_t groupCountY = 1, uint32_t groupCountZ = 1) const;
+
+    template<PushConstantData PushConstants>
+    void dispatch(const PushConstants &pushConstants, uint32_t groupCountX = 1, uint32_t groupCountY = 1,
+                  uint32_t groupCountZ = 1) const;
+    template<PushConstantData PushConstants>
+    Ticket dispatchAsync(const PushConstants &pushConstants, uint32_t groupCountX = 1, uint32_t groupCountY = 1,
+                         uint32_t groupCountZ = 1) const;
+
+    void dispatch(const Bindings &bindings, uint32_t groupCountX = 1, uint32_t groupCountY = 1,
+                  uint32_t groupCountZ = 1) const;
+    Ticket dispatchAsync(const Bindings &bindings, uint32_t groupCountX = 1, uint32_t groupCountY = 1,
+                         uint32_t groupCountZ = 1) const;
+
+    template<PushConstantData PushConstants>
+    void dispatch(const Bindings &bindings, const PushConstants &pushConstants, uint32_t groupCountX = 1,
+                  uint32_t groupCountY = 1, uint32_t groupCountZ = 1) const;
+    template<PushConstantData PushConstants>
+    Ticket dispatchAsync(const Bindings &bindings, const PushConstants &pushConstants, uint32_t groupCountX = 1,
+                         uint32_t groupCountY = 1, uint32_t groupCountZ = 1) const;
+
+    // The group counts are read on the GPU from a VkDispatchIndirectCommand at the given element offset of the buffer,
+    // so they can be computed by an earlier dispatch.
+    template<typename T>
+    void dispatchIndirect(const Buffer<T> &buffer, std::size_t offset = 0) const;
+    template<typename T>
+    Ticket dispatchIndirectAsync(const Buffer<T> &buffer, std::size_t offset = 0) const;
+
+    template<typename T, PushConstantData PushConstants>
+    void dispatchIndirect(const PushConstants &pushConstants, const Buffer<T> &buffer, std::size_t offset = 0) const;
+    template<typename T, PushConstantData PushConstants>
+    Ticket dispatchIndirectAsync(const PushConstants &pushConstants, const Buffer<T> &buffer,
+                                 std::size_t offset = 0) const;
+
+    template<typename T>
+    void dispatchIndirect(const Bindings &bindings, const Buffer<T> &buffer, std::size_t offset = 0) const;
+    template<typename T>
+    Ticket dispatchIndirectAsync(const Bindings &bindings, const Buffer<T> &buffer, std::size_t offset = 0) const;
+
+    template<typename T, PushConstantData PushConstants>
+    void dispatchIndirect(const Bindings &bindings, const PushConstants &pushConstants, const Buffer<T> &buffer,
+                          std::size_t offset = 0) const;
+    template<typename T, PushConstantData PushConstants>
+    Ticket dispatchIndirectAsync(const Bindings &bindings, const PushConstants &pushConstants, const Buffer<T> &buffer,
+                                 std::size_t offset = 0) const;
+
+    // Times every later dispatch()/dispatchAsync() on the GPU. Dispatches recorded into a Sequence are not timed.
+    // Does nothing if the compute queue doesn't support timestamps.
+    void enableTimestamps();
+    // Counts the compute shader invocations of every later dispatch()/dispatchAsync(). Does nothing if the device
+    // doesn't support pipeline statistics queries.
+    void enablePipelineStatistics();
+    // Includes the dispatches that have completed so far.
+    ProgramStats stats() const;
+    void resetStats();
 
 private:
-    template<std::convertible_to<VkBuffer>... Buffers>
-    void initPipeline(const Buffers &...buffers);
+    static constexpr uint32_t DefaultDescriptorPoolSize = 8;
+    static constexpr uint32_t QuerySlotCount = 64;
+
+    struct Queries
+    {
+        VkQueryPool timestampPool{VK_NULL_HANDLE};
+        VkQueryPool statisticsPool{VK_NULL_HANDLE};
+        std::uint64_t nextSlot{0};
+        std::vector<Ticket> slots; // submission whose results are still to be collected, for each slot
+        ProgramStats stats;
+    };
 
+    friend class Sequence;
+    friend class TaskGraph;
+
+    void initPipeline(uint32_t bindingCount);
     void releasePipeline();
+    // The pipeline and descriptor sets must outlive every command buffer submitted with them, including Sequences,
+    // which are submitted behind the program's back, so they are retired against the whole compute queue.
+    Ticket lastSubmission() const;
+
+    // a whole buffer unless it is a view of part of one
+    template<std::convertible_to<VkBuffer> BufferType>
+    static VkDescriptorBufferInfo descriptorInfo(const BufferType &buffer);
+
+    VkDescriptorSet allocateDescriptorSet(VkDescriptorPool &descriptorPool);
+    void updateBindings(Bindings &bindings, std::span<const VkDescriptorBufferInfo> bufferInfos);
+
+    // either direct group counts or the location of a VkDispatchIndirectCommand
+    struct GroupCount
+    {
+        uint32_t x{1};
+        uint32_t y{1};
+        uint32_t z{1};
+        VkBuffer indirectBuffer{VK_NULL_HANDLE};
+        VkDeviceSize indirectOffset{0};
+    };
+
+    Ticket submitDispatch(const Bindings &bindings, std::span<const std::byte> pushConstants,
+                          const GroupCount &groupCount) const;
+    void collectQueries(std::uint32_t slot) const;
+
+    void record(VkCommandBuffer commandBuffer, const Bindings &bindings, std::span<const std::byte> pushConstants,
+                const GroupCount &groupCount) const;
 
     const Device *m_device{nullptr};
     VkShaderModule m_shaderModule{VK_NULL_HANDLE};
+    SpecializationConstants m_specializationConstants;
+    SubgroupSize m_subgroupSize;
+    std::array<uint32_t, 3> m_localSize{}; // zeros if it couldn't be found in the shader
+    uint32_t m_bindingCount{0};
     VkDescriptorSetLayout m_descriptorSetLayout{VK_NULL_HANDLE};
     VkPipelineLayout m_pipelineLayout{VK_NULL_HANDLE};
     VkPipeline m_pipeline{VK_NULL_HANDLE};
-    VkDescriptorPool m_descriptorPool{VK_NULL_HANDLE};
-    VkDescriptorSet m_descriptorSet{VK_NULL_HANDLE};
+    bool m_pushDescriptors{false};
+    std::vector<VkDescriptorPool> m_descriptorPools;
+    Bindings m_bindings;
+    // replaced default bindings, freed once the dispatches submitted until then have completed
+    std::vector<std::pair<Bindings, Ticket>> m_retiredBindings;
+    mutable Queries m_queries;
+};
+
+// A command buffer that is recorded once and can then be submitted any number of times. Recording starts when the
+// sequence is created and finishes with end(); reset() discards the commands and starts over.
+class Sequence
+{
+public:
+    Sequence() = default;
+    explicit Sequence(const Device *device);
+    ~Sequence();
+
+    Sequence(const Sequence &) = delete;
+    Sequence(Sequence &&rhs);
+
+    Sequence &operator=(const Sequence &) = delete;
+    Sequence &operator=(Sequence &&rhs);
+
+    friend inline void swap(Sequence &lhs, Sequence &rhs)
+    {
+        using std::swap;
+        swap(lhs.m_device, rhs.m_device);
+        swap(lhs.m_commandBuffer, rhs.m_commandBuffer);
+        swap(lhs.m_lastSubmission, rhs.m_lastSubmission);
+    }
+
+    operator VkCommandBuffer() const { return m_commandBuffer; }
+
+    void dispatch(const Program &program, uint32_t groupCountX = 1, uint32_t groupCountY = 1,
+                  uint32_t groupCountZ = 1);
+    template<PushConstantData PushConstants>
+    void dispatch(const Program &program, const PushConstants &pushConstants, uint32_t groupCountX = 1,
+                  uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+    void dispatch(const Program &program, const Bindings &bindings, uint32_t groupCountX = 1,
+                  uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+    template<PushConstantData PushConstants>
+    void dispatch(const Program &program, const Bindings &bindings, const PushConstants &pushConstants,
+                  uint32_t groupCountX = 1, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+
+    template<typename T>
+    void dispatchIndirect(const Program &program, const Buffer<T> &buffer, std::size_t offset = 0);
+    template<typename T, PushConstantData PushConstants>
+    void dispatchIndirect(const Program &program, const PushConstants &pushConstants, const Buffer<T> &buffer,
+                          std::size_t offset = 0);
+    template<typename T>
+    void dispatchIndirect(const Program &program, const Bindings &bindings, const Buffer<T> &buffer,
+                          std::size_t offset = 0);
+    template<typename T, PushConstantData PushConstants>
+    void dispatchIndirect(const Program &program, const Bindings &bindings, const PushConstants &pushConstants,
+                          const Buffer<T> &buffer, std::size_t offset = 0);
+
+    // Makes the writes of everything recorded so far visible to what is recorded next, including indirect dispatches
+    // reading their group counts.
+    void barrier();
+
+    template<typename T>
+    void copy(const Buffer<T> &source, const Buffer<T> &destination);
+    template<typename T>
+    void copy(const Buffer<T> &source, const Buffer<T> &destination, std::size_t sourceOffset,
+              std::size_t destinationOffset, std::size_t count = Buffer<T>::WholeSize);
+    template<typename T>
+    void fill(const Buffer<T> &buffer, std::uint32_t value, std::size_t offset = 0,
+              std::size_t count = Buffer<T>::WholeSize);
+    template<typename T>
+    void update(const Buffer<T> &buffer, std::span<const T> data, std::size_t offset = 0);
+
+    void end();
+    void reset();
+
+    Ticket submit();
+    void run();
+
+private:
+    friend class TaskGraph;
+
+    void begin();
+
+    const Device *m_device{nullptr};
+    VkCommandBuffer m_commandBuffer{VK_NULL_HANDLE};
+    Ticket m_lastSubmission;
+};
+
+// The buffers a TaskGraph node reads and writes.
+struct Access
+{
+    std::vector<VkBuffer> reads;
+    std::vector<VkBuffer> writes;
+};
+
+// Dispatches that declare the buffers they access, recorded into a Sequence in dependency order. A node depends on the
+// earlier nodes it has a read-after-write, write-after-read or write-after-write hazard with. Nodes are grouped into
+// levels that only depend on earlier levels, so the dispatches of a level can overlap on the GPU and consecutive levels
+// are separated by a single barrier. Programs, bindings and buffers must outlive the graph.
+class TaskGraph
+{
+public:
+    void dispatch(const Program &program, const Access &access, uint32_t groupCountX = 1, uint32_t groupCountY = 1,
+                  uint32_t groupCountZ = 1);
+    template<PushConstantData PushConstants>
+    void dispatch(const Program &program, const PushConstants &pushConstants, const Access &access,
+                  uint32_t groupCountX = 1, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+    void dispatch(const Program &program, const Bindings &bindings, const Access &access, uint32_t groupCountX = 1,
+                  uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+    template<PushConstantData PushConstants>
+    void dispatch(const Program &program, const Bindings &bindings, const PushConstants &pushConstants,
+                  const Access &access, uint32_t groupCountX = 1, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+
+    // The indirect buffer counts as read by the node, it doesn't need to be listed in access.
+    template<typename T>
+    void dispatchIndirect(const Program &program, const Access &access, const Buffer<T> &buffer,
+                          std::size_t offset = 0);
+    template<typename T, PushConstantData PushConstants>
+    void dispatchIndirect(const Program &program, const PushConstants &pushConstants, const Access &access,
+                          const Buffer<T> &buffer, std::size_t offset = 0);
+    template<typename T>
+    void dispatchIndirect(const Program &program, const Bindings &bindings, const Access &access,
+                          const Buffer<T> &buffer, std::size_t offset = 0);
+    template<typename T, PushConstantData PushConstants>
+    void dispatchIndirect(const Program &program, const Bindings &bindings, const PushConstants &pushConstants,
+                          const Access &access, const Buffer<T> &buffer, std::size_t offset = 0);
+
+    std::size_t size() const { return m_nodes.size(); }
+    void clear() { m_nodes.clear(); }
+
+    // Records every node into the sequence. Does not order the nodes against commands recorded before or after.
+    void record(Sequence &sequence) const;
+
+private:
+    struct Node
+    {
+        const Program *program{nullptr};
+        const Bindings *bindings{nullptr}; // the program's own bindings when null
+        std::vector<std::byte> pushConstants;
+        Program::GroupCount groupCount;
+        Access access;
+    };
+
+    void addNode(const Program &program, const Bindings *bindings, std::span<const std::byte> pushConstants,
+                 const Program::GroupCount &groupCount, const Access &access);
+    static bool dependsOn(const Node &node, const Node &earlier);
+    static void recordBarrier(const Sequence &sequence, bool indirect);
+
+    std::vector<Node> m_nodes;
+};
+
+// Splits a 1-D range of work items across all usable devices. Each device keeps a few chunks in flight, and chunks
+// grow with the throughput a device has shown so far, so faster devices end up with a larger share of the range.
+class MultiDeviceExecutor
+{
+public:
+    // Submits the items [offset, offset + count) on the given device, returning the ticket of the submission.
+    using Submit = std::function<Ticket(std::size_t device, std::uint64_t offset, std::uint64_t count)>;
+    // Called once the submission for [offset, offset + count) has completed, in submission order for each device.
+    using Gather = std::function<void(std::size_t device, std::uint64_t offset, std::uint64_t count)>;
+
+    static constexpr std::uint32_t DefaultMaxInFlight = 2;
+    static constexpr std::uint64_t NoChunkLimit = ~std::uint64_t{0};
+
+    // Chunk sizes are multiples of granularity and no larger than maxChunkSize, e.g. to stay within the device's
+    // maximum workgroup count. Devices without a compute queue are skipped.
+    MultiDeviceExecutor(std::span<Device> devices, std::uint64_t granularity, std::uint64_t maxChunkSize = NoChunkLimit,
+                        std::uint32_t maxInFlight = DefaultMaxInFlight);
+
+    std::span<Device *const> devices() const { return m_devices; }
+    // items per second measured on each device during the last run()
+    std::span<const double> throughput() const { return m_throughput; }
+
+    void run(std::uint64_t count, const Submit &submit, const Gather &gather);
+
+private:
+    static constexpr std::chrono::milliseconds MaxPollInterval{1};
+
+    std::uint64_t chunkSize(std::size_t device) const;
+
+    std::vector<Device *> m_devices;
+    std::uint64_t m_granularity{1};
+    std::uint64_t m_maxChunkSize{NoChunkLimit};
+    std::uint32_t m_maxInFlight{DefaultMaxInFlight};
+    std::vector<double> m_throughput;
 };
 
 } // namespace vc
@@ -186,27 +987,166 @@ namespace vc
 namespace
 {
 
-uint32_t findComputeQueueFamily(VkPhysicalDevice physDevice)
+VKAPI_ATTR VkBool32 VKAPI_CALL debugMessengerCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+                                                      VkDebugUtilsMessageTypeFlagsEXT,
+                                                      const VkDebugUtilsMessengerCallbackDataEXT *callbackData, void *)
+{
+    const char *label = severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT     ? "error"
+                        : severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT ? "warning"
+                        : severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT    ? "info"
+                                                                                      : "verbose";
+    std::fprintf(stderr, "[vulkan %s] %s\n", label, callbackData->pMessage);
+    return VK_FALSE;
+}
+
+std::set<std::string> supportedDeviceExtensions(VkPhysicalDevice physDevice)
+{
+    uint32_t extensionCount = 0;
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(physDevice, nullptr, &extensionCount, nullptr));
+
+    std::vector<VkExtensionProperties> extensionProperties(extensionCount);
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(physDevice, nullptr, &extensionCount, extensionProperties.data()));
+
+    std::set<std::string> extensions;
+    for (const auto &properties : extensionProperties)
+        extensions.insert(properties.extensionName);
+    return extensions;
+}
+
+std::vector<VkWriteDescriptorSet> makeWriteDescriptorSets(VkDescriptorSet descriptorSet,
+                                                          std::span<const VkDescriptorBufferInfo> bufferInfos)
+{
+    std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+    writeDescriptorSets.reserve(bufferInfos.size());
+    for (uint32_t i = 0; i < bufferInfos.size(); ++i)
+    {
+        writeDescriptorSets.push_back({.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                       .pNext = nullptr,
+                                       .dstSet = descriptorSet,
+                                       .dstBinding = i,
+                                       .dstArrayElement = 0,
+                                       .descriptorCount = 1,
+                                       .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                       .pImageInfo = nullptr,
+                                       .pBufferInfo = &bufferInfos[i],
+                                       .pTexelBufferView = nullptr});
+    }
+    return writeDescriptorSets;
+}
+
+std::vector<VkQueueFamilyProperties> queueFamilies(VkPhysicalDevice physDevice)
 {
     uint32_t queueFamilyPropertiesCount = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(physDevice, &queueFamilyPropertiesCount, nullptr);
 
     std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyPropertiesCount);
     vkGetPhysicalDeviceQueueFamilyProperties(physDevice, &queueFamilyPropertiesCount, queueFamilyProperties.data());
+    return queueFamilyProperties;
+}
 
-    auto it = std::ranges::find_if(queueFamilyProperties, [](const VkQueueFamilyProperties &properties) -> bool {
-        const VkQueueFlags flags = properties.queueFlags;
-        return flags & VK_QUEUE_COMPUTE_BIT;
-    });
+// the first family whose flags satisfy the predicate, ~0u if there is none
+template<std::predicate<VkQueueFlags> Predicate>
+uint32_t findQueueFamily(std::span<const VkQueueFamilyProperties> queueFamilyProperties, Predicate predicate)
+{
+    const auto it = std::ranges::find_if(queueFamilyProperties, predicate, &VkQueueFamilyProperties::queueFlags);
     if (it == queueFamilyProperties.end())
         return ~0u;
 
     return std::distance(queueFamilyProperties.begin(), it);
 }
 
-std::optional<std::vector<std::byte>> readFile(const std::string &path)
+// The x, y and z local size of a compute shader, following local_size_*_id and the WorkgroupSize built-in to the
+// specialization constants. Zeros if the shader doesn't declare it.
+std::array<uint32_t, 3> findLocalSize(std::span<const uint32_t> code,
+                                      const SpecializationConstants &specializationConstants)
+{
+    constexpr uint32_t OpExecutionMode = 16;
+    constexpr uint32_t OpConstant = 43;
+    constexpr uint32_t OpConstantComposite = 44;
+    constexpr uint32_t OpSpecConstant = 50;
+    constexpr uint32_t OpSpecConstantComposite = 51;
+    constexpr uint32_t OpDecorate = 71;
+    constexpr uint32_t OpExecutionModeId = 331;
+    constexpr uint32_t ExecutionModeLocalSize = 17;
+    constexpr uint32_t ExecutionModeLocalSizeId = 38;
+    constexpr uint32_t DecorationSpecId = 1;
+    constexpr uint32_t DecorationBuiltIn = 11;
+    constexpr uint32_t BuiltInWorkgroupSize = 25;
+    constexpr std::size_t HeaderSize = 5;
+
+    std::array<uint32_t, 3> localSize{};
+    std::span<const uint32_t> localSizeIds;
+    uint32_t workgroupSizeId = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> specIds;                    // result id, constant id
+    std::vector<std::pair<uint32_t, std::span<const uint32_t>>> constants; // result id, value or constituents
+    for (std::size_t i = HeaderSize; i < code.size();)
+    {
+        const uint32_t wordCount = code[i] >> 16;
+        const uint32_t opcode = code[i] & 0xffff;
+        if (wordCount == 0 || i + wordCount > code.size())
+            break;
+        const auto operands = code.subspan(i + 1, wordCount - 1);
+        switch (opcode)
+        {
+        case OpExecutionMode:
+            if (operands.size() >= 5 && operands[1] == ExecutionModeLocalSize)
+                std::ranges::copy(operands.subspan(2, 3), localSize.begin());
+            break;
+        case OpExecutionModeId:
+            if (operands.size() >= 5 && operands[1] == ExecutionModeLocalSizeId)
+                localSizeIds = operands.subspan(2, 3);
+            break;
+        case OpDecorate:
+            if (operands.size() >= 3 && operands[1] == DecorationSpecId)
+                specIds.emplace_back(operands[0], operands[2]);
+            else if (operands.size() >= 3 && operands[1] == DecorationBuiltIn && operands[2] == BuiltInWorkgroupSize)
+                workgroupSizeId = operands[0];
+            break;
+        case OpConstant:
+        case OpConstantComposite:
+        case OpSpecConstant:
+        case OpSpecConstantComposite:
+            if (operands.size() >= 3)
+                constants.emplace_back(operands[1], operands.subspan(2));
+            break;
+        }
+        i += wordCount;
+    }
+
+    const auto resolve = [&](uint32_t id) -> uint32_t {
+        const auto specId = std::ranges::find(specIds, id, &std::pair<uint32_t, uint32_t>::first);
+        if (specId != specIds.end())
+        {
+            if (const auto value = specializationConstants.get(specId->second); value.has_value())
+                return *value;
+        }
+        const auto constant =
+            std::ranges::find(constants, id, &std::pair<uint32_t, std::span<const uint32_t>>::first);
+        return constant != constants.end() ? constant->second[0] : 0;
+    };
+    const auto resolveAll = [&](std::span<const uint32_t> ids) {
+        std::array<uint32_t, 3> values{};
+        if (ids.size() >= 3)
+            std::ranges::transform(ids.first(3), values.begin(), resolve);
+        return values;
+    };
+
+    // the built-in overrides the execution modes
+    if (workgroupSizeId != 0)
+    {
+        const auto workgroupSize =
+            std::ranges::find(constants, workgroupSizeId, &std::pair<uint32_t, std::span<const uint32_t>>::first);
+        return workgroupSize != constants.end() ? resolveAll(workgroupSize->second) : std::array<uint32_t, 3>{};
+    }
+    if (!localSizeIds.empty())
+        return resolveAll(localSizeIds);
+    return localSize;
+}
+
+using File = std::unique_ptr<std::FILE, decltype(&std::fclose)>;
+
+std::optional<std::vector<std::byte>> readFile(const std::filesystem::path &path)
 {
-    using File = std::unique_ptr<std::FILE, decltype(&std::fclose)>;
     File file(std::fopen(path.c_str(), "rb"), std::fclose);
     if (!file)
         return std::nullopt;
@@ -219,10 +1159,82 @@ std::optional<std::vector<std::byte>> readFile(const std::string &path)
     return data;
 }
 
+bool writeFile(const std::filesystem::path &path, std::span<const std::byte> data)
+{
+    File file(std::fopen(path.c_str(), "wb"), std::fclose);
+    if (!file)
+        return false;
+    return std::fwrite(data.data(), 1, data.size(), file.get()) == data.size();
+}
+
 } // namespace
 
-Program::Program(const Device *device, const std::string &path)
-    : m_device(device)
+template<typename T>
+    requires std::is_arithmetic_v<T>
+SpecializationConstants &SpecializationConstants::set(std::uint32_t id, T value)
+{
+    using Stored = std::conditional_t<std::is_same_v<T, bool>, VkBool32, T>;
+    const Stored stored = value;
+    const auto bytes = std::as_bytes(std::span(&stored, 1));
+
+    auto it = std::ranges::find(m_entries, id, &VkSpecializationMapEntry::constantID);
+    if (it != m_entries.end() && it->size == bytes.size())
+    {
+        std::ranges::copy(bytes, m_data.begin() + it->offset);
+        return *this;
+    }
+    if (it == m_entries.end())
+        it = m_entries.insert(it, VkSpecializationMapEntry{.constantID = id});
+    it->offset = m_data.size();
+    it->size = bytes.size();
+    m_data.insert(m_data.end(), bytes.begin(), bytes.end());
+    return *this;
+}
+
+std::optional<std::uint32_t> SpecializationConstants::get(std::uint32_t id) const
+{
+    const auto it = std::ranges::find(m_entries, id, &VkSpecializationMapEntry::constantID);
+    if (it == m_entries.end() || it->size != sizeof(std::uint32_t))
+        return std::nullopt;
+    std::uint32_t value;
+    std::memcpy(&value, m_data.data() + it->offset, sizeof(value));
+    return value;
+}
+
+VkSpecializationInfo SpecializationConstants::info() const
+{
+    return {.mapEntryCount = static_cast<uint32_t>(m_entries.size()),
+            .pMapEntries = m_entries.data(),
+            .dataSize = m_data.size(),
+            .pData = m_data.data()};
+}
+
+Bindings::~Bindings()
+{
+    if (m_descriptorSet)
+        vkFreeDescriptorSets(*m_device, m_descriptorPool, 1, &m_descriptorSet);
+}
+
+Bindings::Bindings(Bindings &&rhs)
+    : m_device(std::exchange(rhs.m_device, nullptr))
+    , m_descriptorPool(std::exchange(rhs.m_descriptorPool, VK_NULL_HANDLE))
+    , m_descriptorSet(std::exchange(rhs.m_descriptorSet, VK_NULL_HANDLE))
+    , m_bufferInfos(std::move(rhs.m_bufferInfos))
+{
+}
+
+Bindings &Bindings::operator=(Bindings &&rhs)
+{
+    Bindings temp(std::move(rhs));
+    swap(*this, temp);
+    return *this;
+}
+
+Program::Program(const Device *device, const std::string &path, SpecializationConstants specializationConstants,
+                 SubgroupSize subgroupSize)
+    : m_device(device)
+    , m_specializationConstants(std::move(specializationConstants))
+    , m_subgroupSize(subgroupSize)
 {
     auto shaderCode = readFile(path);
     if (shaderCode.has_value())
@@ -235,25 +1247,47 @@ Program::Program(const Device *device, const std::string &path)
                                                                      reinterpret_cast<uint32_t *>(shaderCode->data())};
 
         VK_CHECK(vkCreateShaderModule(*m_device, &shaderModuleCreateInfo, 0, &m_shaderModule));
+
+        m_localSize = findLocalSize(
+            {reinterpret_cast<const uint32_t *>(shaderCode->data()), shaderCode->size() / sizeof(uint32_t)},
+            m_specializationConstants);
     }
 }
 
 Program::~Program()
 {
+    // also covers the submissions whose queries are still to be collected, they were submitted earlier
+    lastSubmission().wait();
+
     if (m_shaderModule)
         vkDestroyShaderModule(*m_device, m_shaderModule, nullptr);
 
     releasePipeline();
+
+    for (auto descriptorPool : m_descriptorPools)
+        vkDestroyDescriptorPool(*m_device, descriptorPool, nullptr);
+
+    if (m_queries.timestampPool)
+        vkDestroyQueryPool(*m_device, m_queries.timestampPool, nullptr);
+    if (m_queries.statisticsPool)
+        vkDestroyQueryPool(*m_device, m_queries.statisticsPool, nullptr);
 }
 
 Program::Program(Program &&rhs)
     : m_device(std::exchange(rhs.m_device, nullptr))
     , m_shaderModule(std::exchange(rhs.m_shaderModule, VK_NULL_HANDLE))
+    , m_specializationConstants(std::move(rhs.m_specializationConstants))
+    , m_subgroupSize(rhs.m_subgroupSize)
+    , m_localSize(std::exchange(rhs.m_localSize, {}))
+    , m_bindingCount(std::exchange(rhs.m_bindingCount, 0))
     , m_descriptorSetLayout(std::exchange(rhs.m_descriptorSetLayout, VK_NULL_HANDLE))
     , m_pipelineLayout(std::exchange(rhs.m_pipelineLayout, VK_NULL_HANDLE))
     , m_pipeline(std::exchange(rhs.m_pipeline, VK_NULL_HANDLE))
-    , m_descriptorPool(std::exchange(rhs.m_descriptorPool, VK_NULL_HANDLE))
-    , m_descriptorSet(std::exchange(rhs.m_descriptorSet, VK_NULL_HANDLE))
+    , m_pushDescriptors(std::exchange(rhs.m_pushDescriptors, false))
+    , m_descriptorPools(std::move(rhs.m_descriptorPools))
+    , m_bindings(std::move(rhs.m_bindings))
+    , m_retiredBindings(std::move(rhs.m_retiredBindings))
+    , m_queries(std::exchange(rhs.m_queries, {}))
 {
 }
 
@@ -266,370 +1300,2380 @@ Program &Program::operator=(Program &&rhs)
 
 void Program::releasePipeline()
 {
-    if (m_descriptorPool)
-        vkDestroyDescriptorPool(*m_device, m_descriptorPool, nullptr);
+    lastSubmission().wait();
+
+    m_bindings = Bindings();
+    m_retiredBindings.clear();
 
     if (m_pipeline)
-        vkDestroyPipeline(*m_device, m_pipeline, nullptr);
+        vkDestroyPipeline(*m_device, std::exchange(m_pipeline, VK_NULL_HANDLE), nullptr);
 
     if (m_pipelineLayout)
-        vkDestroyPipelineLayout(*m_device, m_pipelineLayout, nullptr);
+        vkDestroyPipelineLayout(*m_device, std::exchange(m_pipelineLayout, VK_NULL_HANDLE), nullptr);
 
     if (m_descriptorSetLayout)
-        vkDestroyDescriptorSetLayout(*m_device, m_descriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(*m_device, std::exchange(m_descriptorSetLayout, VK_NULL_HANDLE), nullptr);
+}
+
+Ticket Program::lastSubmission() const
+{
+    return m_device ? m_device->computeQueue()->lastSubmission() : Ticket();
 }
 
 template<std::convertible_to<VkBuffer>... Buffers>
 void Program::bind(const Buffers &...buffers)
 {
-    releasePipeline();
-    initPipeline(buffers...);
+    // the pipeline only depends on the number of bindings, so rebinding normally just needs a new descriptor set
+    if (!m_pipeline || m_bindingCount != sizeof...(Buffers))
+    {
+        releasePipeline();
+        initPipeline(sizeof...(Buffers));
+    }
+    else if (m_bindings.m_descriptorSet)
+    {
+        // updating the set in place would invalidate the command buffers that use it
+        std::erase_if(m_retiredBindings, [](const auto &retired) { return retired.second.isReady(); });
+        m_retiredBindings.emplace_back(std::exchange(m_bindings, Bindings()), lastSubmission());
+    }
+    const std::array<VkDescriptorBufferInfo, sizeof...(Buffers)> bufferInfos = {descriptorInfo(buffers)...};
+    updateBindings(m_bindings, bufferInfos);
 }
 
 template<std::convertible_to<VkBuffer>... Buffers>
-void Program::initPipeline(const Buffers &...buffers)
-{
-    const auto descriptorSetLayoutBindings = std::invoke(
-        []<std::size_t... Idx>(std::index_sequence<Idx...>) {
-            return std::array{VkDescriptorSetLayoutBinding{.binding = Idx,
-                                                           .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-                                                           .descriptorCount = 1,
-                                                           .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-                                                           .pImmutableSamplers = nullptr}...};
-        },
-        std::index_sequence_for<Buffers...>{});
+Bindings Program::makeBindings(const Buffers &...buffers)
+{
+    if (!m_pipeline || m_bindingCount != sizeof...(Buffers))
+    {
+        releasePipeline();
+        initPipeline(sizeof...(Buffers));
+    }
+    const std::array<VkDescriptorBufferInfo, sizeof...(Buffers)> bufferInfos = {descriptorInfo(buffers)...};
+    Bindings bindings;
+    updateBindings(bindings, bufferInfos);
+    return bindings;
+}
+
+template<std::convertible_to<VkBuffer> BufferType>
+VkDescriptorBufferInfo Program::descriptorInfo(const BufferType &buffer)
+{
+    if constexpr (requires { buffer.descriptorInfo(); })
+        return buffer.descriptorInfo();
+    else
+        return {.buffer = static_cast<VkBuffer>(buffer), .offset = 0, .range = VK_WHOLE_SIZE};
+}
+
+void Program::initPipeline(uint32_t bindingCount)
+{
+    m_bindingCount = bindingCount;
+    m_pushDescriptors = bindingCount > 0 && bindingCount <= m_device->maxPushDescriptors();
+
+    std::vector<VkDescriptorSetLayoutBinding> descriptorSetLayoutBindings;
+    for (uint32_t i = 0; i < bindingCount; ++i)
+    {
+        descriptorSetLayoutBindings.push_back({.binding = i,
+                                               .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                               .descriptorCount = 1,
+                                               .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                                               .pImmutableSamplers = nullptr});
+    }
 
     const VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
         .pNext = nullptr,
-        .flags = 0,
+        .flags = m_pushDescriptors ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0u,
         .bindingCount = static_cast<uint32_t>(descriptorSetLayoutBindings.size()),
         .pBindings = descriptorSetLayoutBindings.data()};
     VK_CHECK(vkCreateDescriptorSetLayout(*m_device, &descriptorSetLayoutCreateInfo, nullptr, &m_descriptorSetLayout));
 
+    // always declare the whole guaranteed push constant range, shaders are free to use any part of it
+    const VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = MaxPushConstantsSize};
     const VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
                                                                  .pNext = nullptr,
                                                                  .flags = 0,
                                                                  .setLayoutCount = 1,
                                                                  .pSetLayouts = &m_descriptorSetLayout,
-                                                                 .pushConstantRangeCount = 0,
-                                                                 .pPushConstantRanges = nullptr};
+                                                                 .pushConstantRangeCount = 1,
+                                                                 .pPushConstantRanges = &pushConstantRange};
     VK_CHECK(vkCreatePipelineLayout(*m_device, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout));
 
+    const auto specializationInfo = m_specializationConstants.info();
+
+    const auto &sizeControl = m_device->subgroupSizeControlProperties();
+    const auto required = m_subgroupSize.required;
+    const auto invocations = m_localSize[0] * m_localSize[1] * m_localSize[2];
+    const bool requireSubgroupSize =
+        required != 0 && m_device->hasSubgroupSizeControl() && std::has_single_bit(required) &&
+        required >= sizeControl.minSubgroupSize && required <= sizeControl.maxSubgroupSize &&
+        (invocations == 0 || invocations <= sizeControl.maxComputeWorkgroupSubgroups * required);
+    // without a required size the driver may pick any size up to the maximum
+    const auto subgroupSize = requireSubgroupSize ? required : m_device->subgroupProperties().subgroupSize;
+    const auto maxSubgroupSize = requireSubgroupSize ? required : std::max(sizeControl.maxSubgroupSize, subgroupSize);
+    const bool requireFullSubgroups = m_subgroupSize.fullSubgroups && m_device->hasComputeFullSubgroups() &&
+                                      m_localSize[0] != 0 && m_localSize[0] % maxSubgroupSize == 0;
+    const VkPipelineShaderStageRequiredSubgroupSizeCreateInfo requiredSubgroupSizeCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO,
+        .pNext = nullptr,
+        .requiredSubgroupSize = m_subgroupSize.required};
+    const VkPipelineShaderStageCreateFlags stageFlags =
+        requireFullSubgroups ? VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT : 0u;
+
     const VkComputePipelineCreateInfo computePipelineCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
         .pNext = nullptr,
         .flags = 0,
         .stage = VkPipelineShaderStageCreateInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                                                 .pNext = nullptr,
-                                                 .flags = 0,
+                                                 .pNext = requireSubgroupSize ? &requiredSubgroupSizeCreateInfo
+                                                                              : nullptr,
+                                                 .flags = stageFlags,
                                                  .stage = VK_SHADER_STAGE_COMPUTE_BIT,
                                                  .module = m_shaderModule,
                                                  .pName = "main",
-                                                 .pSpecializationInfo = nullptr},
+                                                 .pSpecializationInfo = m_specializationConstants.empty()
+                                                                            ? nullptr
+                                                                            : &specializationInfo},
         .layout = m_pipelineLayout,
         .basePipelineHandle = VK_NULL_HANDLE,
         .basePipelineIndex = 0};
-    VK_CHECK(vkCreateComputePipelines(*m_device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &m_pipeline));
+    VK_CHECK(vkCreateComputePipelines(*m_device, m_device->pipelineCache(), 1, &computePipelineCreateInfo, nullptr,
+                                      &m_pipeline));
+}
+
+VkDescriptorSet Program::allocateDescriptorSet(VkDescriptorPool &descriptorPool)
+{
+    // newest pools first, they are the most likely to still have room
+    for (auto it = m_descriptorPools.rbegin(); it != m_descriptorPools.rend(); ++it)
+    {
+        const VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .descriptorPool = *it,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &m_descriptorSetLayout};
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        const auto status = vkAllocateDescriptorSets(*m_device, &descriptorSetAllocateInfo, &descriptorSet);
+        if (status == VK_SUCCESS)
+        {
+            descriptorPool = *it;
+            return descriptorSet;
+        }
+        if (status != VK_ERROR_OUT_OF_POOL_MEMORY && status != VK_ERROR_FRAGMENTED_POOL)
+            VK_CHECK(status);
+    }
 
+    // every pool is full, add one twice the size of the previous one
+    const uint32_t maxSets = DefaultDescriptorPoolSize << m_descriptorPools.size();
     const VkDescriptorPoolSize descriptorPoolSize = {
         .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        .descriptorCount = sizeof...(Buffers),
+        .descriptorCount = maxSets * std::max(m_bindingCount, 1u),
     };
-    const VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-                                                                 .pNext = nullptr,
-                                                                 .flags = 0,
-                                                                 .maxSets = 1,
-                                                                 .poolSizeCount = 1,
-                                                                 .pPoolSizes = &descriptorPoolSize};
-    VK_CHECK(vkCreateDescriptorPool(*m_device, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool));
+    const VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = maxSets,
+        .poolSizeCount = 1,
+        .pPoolSizes = &descriptorPoolSize};
+    VK_CHECK(vkCreateDescriptorPool(*m_device, &descriptorPoolCreateInfo, nullptr, &descriptorPool));
+    m_descriptorPools.push_back(descriptorPool);
 
     const VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {.sType =
                                                                        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
                                                                    .pNext = nullptr,
-                                                                   .descriptorPool = m_descriptorPool,
+                                                                   .descriptorPool = descriptorPool,
                                                                    .descriptorSetCount = 1,
                                                                    .pSetLayouts = &m_descriptorSetLayout};
-    VK_CHECK(vkAllocateDescriptorSets(*m_device, &descriptorSetAllocateInfo, &m_descriptorSet));
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VK_CHECK(vkAllocateDescriptorSets(*m_device, &descriptorSetAllocateInfo, &descriptorSet));
+    return descriptorSet;
+}
 
-    const auto bufferInfos = std::array{
-        VkDescriptorBufferInfo{.buffer = static_cast<VkBuffer>(buffers), .offset = 0, .range = VK_WHOLE_SIZE}...};
-    const auto writeDescriptorSets = std::invoke(
-        [this, &bufferInfos]<std::size_t... Idx>(std::index_sequence<Idx...>) {
-            return std::array{VkWriteDescriptorSet{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                                                   .pNext = nullptr,
-                                                   .dstSet = m_descriptorSet,
-                                                   .dstBinding = Idx,
-                                                   .dstArrayElement = 0,
-                                                   .descriptorCount = 1,
-                                                   .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-                                                   .pImageInfo = nullptr,
-                                                   .pBufferInfo = &bufferInfos[Idx],
-                                                   .pTexelBufferView = nullptr}...};
-        },
-        std::index_sequence_for<Buffers...>{});
+void Program::updateBindings(Bindings &bindings, std::span<const VkDescriptorBufferInfo> bufferInfos)
+{
+    bindings.m_device = m_device;
+    if (m_bindingCount == 0)
+        return;
+
+    if (m_pushDescriptors)
+    {
+        // nothing to allocate, the buffers are pushed into the command buffer when the dispatch is recorded
+        bindings.m_bufferInfos.assign(bufferInfos.begin(), bufferInfos.end());
+        return;
+    }
+
+    if (!bindings.m_descriptorSet)
+        bindings.m_descriptorSet = allocateDescriptorSet(bindings.m_descriptorPool);
+    const auto writeDescriptorSets = makeWriteDescriptorSets(bindings.m_descriptorSet, bufferInfos);
     vkUpdateDescriptorSets(*m_device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
 }
 
 void Program::dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) const
 {
-    const auto commandBuffer = m_device->commandBuffer();
-    const auto queue = m_device->computeQueue();
+    submitDispatch(m_bindings, {}, {groupCountX, groupCountY, groupCountZ}).wait();
+}
 
-    const VkCommandBufferBeginInfo commandBufferBeginInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-                                                             .pNext = nullptr,
-                                                             .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-                                                             .pInheritanceInfo = nullptr};
-    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0,
-                            nullptr);
-    vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
-    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+Ticket Program::dispatchAsync(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) const
+{
+    return submitDispatch(m_bindings, {}, {groupCountX, groupCountY, groupCountZ});
+}
 
-    const VkSubmitInfo submitInfo = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                                     .pNext = nullptr,
-                                     .waitSemaphoreCount = 0,
-                                     .pWaitSemaphores = nullptr,
-                                     .pWaitDstStageMask = nullptr,
-                                     .commandBufferCount = 1,
-                                     .pCommandBuffers = &commandBuffer,
-                                     .signalSemaphoreCount = 0,
-                                     .pSignalSemaphores = nullptr};
-    VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, 0));
+template<PushConstantData PushConstants>
+void Program::dispatch(const PushConstants &pushConstants, uint32_t groupCountX, uint32_t groupCountY,
+                       uint32_t groupCountZ) const
+{
+    submitDispatch(m_bindings, std::as_bytes(std::span(&pushConstants, 1)), {groupCountX, groupCountY, groupCountZ})
+        .wait();
+}
 
-    VK_CHECK(vkQueueWaitIdle(queue));
+template<PushConstantData PushConstants>
+Ticket Program::dispatchAsync(const PushConstants &pushConstants, uint32_t groupCountX, uint32_t groupCountY,
+                              uint32_t groupCountZ) const
+{
+    return submitDispatch(m_bindings, std::as_bytes(std::span(&pushConstants, 1)),
+                          {groupCountX, groupCountY, groupCountZ});
 }
 
-template<typename T>
-Buffer<T>::Buffer(const Device *device, std::size_t size)
-    : m_device(device)
-    , m_sizeInBytes(size * sizeof(T))
+void Program::dispatch(const Bindings &bindings, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) const
 {
-    const auto memoryTypeIndex = device->findHostVisibleMemory(size);
-    if (memoryTypeIndex != ~0u)
-    {
-        uint32_t computeQueueFamilyIndex = device->computeQueueFamilyIndex();
-        const VkBufferCreateInfo bufferCreateInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-                                                     .pNext = nullptr,
-                                                     .flags = 0,
-                                                     .size = m_sizeInBytes,
-                                                     .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                                                     .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-                                                     .queueFamilyIndexCount = 1,
-                                                     .pQueueFamilyIndices = &computeQueueFamilyIndex};
-        VK_CHECK(vkCreateBuffer(*m_device, &bufferCreateInfo, nullptr, &m_buffer));
+    submitDispatch(bindings, {}, {groupCountX, groupCountY, groupCountZ}).wait();
+}
 
-        VkMemoryRequirements memoryRequirements{};
-        vkGetBufferMemoryRequirements(*m_device, m_buffer, &memoryRequirements);
+Ticket Program::dispatchAsync(const Bindings &bindings, uint32_t groupCountX, uint32_t groupCountY,
+                              uint32_t groupCountZ) const
+{
+    return submitDispatch(bindings, {}, {groupCountX, groupCountY, groupCountZ});
+}
 
-        const VkMemoryAllocateInfo memoryAllocateInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-                                                         .pNext = nullptr,
-                                                         .allocationSize = memoryRequirements.size,
-                                                         .memoryTypeIndex = memoryTypeIndex};
-        VK_CHECK(vkAllocateMemory(*m_device, &memoryAllocateInfo, nullptr, &m_deviceMemory));
+template<PushConstantData PushConstants>
+void Program::dispatch(const Bindings &bindings, const PushConstants &pushConstants, uint32_t groupCountX,
+                       uint32_t groupCountY, uint32_t groupCountZ) const
+{
+    submitDispatch(bindings, std::as_bytes(std::span(&pushConstants, 1)), {groupCountX, groupCountY, groupCountZ})
+        .wait();
+}
 
-        VK_CHECK(vkBindBufferMemory(*m_device, m_buffer, m_deviceMemory, 0));
-    }
+template<PushConstantData PushConstants>
+Ticket Program::dispatchAsync(const Bindings &bindings, const PushConstants &pushConstants, uint32_t groupCountX,
+                              uint32_t groupCountY, uint32_t groupCountZ) const
+{
+    return submitDispatch(bindings, std::as_bytes(std::span(&pushConstants, 1)),
+                          {groupCountX, groupCountY, groupCountZ});
 }
 
 template<typename T>
-Buffer<T>::Buffer(const Device *device, std::span<const T> data)
-    : Buffer(device, data.size())
+void Program::dispatchIndirect(const Buffer<T> &buffer, std::size_t offset) const
 {
-    auto bufferData = map();
-    std::ranges::copy(data, bufferData.begin());
-    unmap();
+    submitDispatch(m_bindings, {}, {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)}).wait();
 }
 
 template<typename T>
-Buffer<T>::~Buffer()
+Ticket Program::dispatchIndirectAsync(const Buffer<T> &buffer, std::size_t offset) const
 {
-    if (m_buffer)
-        vkDestroyBuffer(*m_device, m_buffer, nullptr);
+    return submitDispatch(m_bindings, {}, {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)});
+}
 
-    if (m_deviceMemory)
-        vkFreeMemory(*m_device, m_deviceMemory, nullptr);
+template<typename T, PushConstantData PushConstants>
+void Program::dispatchIndirect(const PushConstants &pushConstants, const Buffer<T> &buffer, std::size_t offset) const
+{
+    submitDispatch(m_bindings, std::as_bytes(std::span(&pushConstants, 1)),
+                   {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)})
+        .wait();
 }
 
-template<typename T>
-Buffer<T>::Buffer(Buffer &&rhs)
-    : m_device(std::exchange(rhs.m_device, nullptr))
-    , m_sizeInBytes(std::exchange(rhs.m_sizeInBytes, 0))
-    , m_deviceMemory(std::exchange(rhs.m_deviceMemory, VK_NULL_HANDLE))
-    , m_buffer(std::exchange(rhs.m_buffer, VK_NULL_HANDLE))
+template<typename T, PushConstantData PushConstants>
+Ticket Program::dispatchIndirectAsync(const PushConstants &pushConstants, const Buffer<T> &buffer,
+                                      std::size_t offset) const
 {
+    return submitDispatch(m_bindings, std::as_bytes(std::span(&pushConstants, 1)),
+                          {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)});
 }
 
 template<typename T>
-Buffer<T> &Buffer<T>::operator=(Buffer &&rhs)
+void Program::dispatchIndirect(const Bindings &bindings, const Buffer<T> &buffer, std::size_t offset) const
 {
-    Buffer temp(std::move(rhs));
-    swap(*this, temp);
-    return *this;
+    submitDispatch(bindings, {}, {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)}).wait();
 }
 
 template<typename T>
-std::span<T> Buffer<T>::map() const
+Ticket Program::dispatchIndirectAsync(const Bindings &bindings, const Buffer<T> &buffer, std::size_t offset) const
 {
-    std::byte *data;
-    VK_CHECK(vkMapMemory(*m_device, m_deviceMemory, 0, m_sizeInBytes, 0, reinterpret_cast<void **>(&data)));
-    return {reinterpret_cast<T *>(data), m_sizeInBytes / sizeof(T)};
+    return submitDispatch(bindings, {}, {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)});
 }
 
-template<typename T>
-void Buffer<T>::unmap() const
+template<typename T, PushConstantData PushConstants>
+void Program::dispatchIndirect(const Bindings &bindings, const PushConstants &pushConstants, const Buffer<T> &buffer,
+                               std::size_t offset) const
 {
-    vkUnmapMemory(*m_device, m_deviceMemory);
+    submitDispatch(bindings, std::as_bytes(std::span(&pushConstants, 1)),
+                   {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)})
+        .wait();
 }
 
-Device::Device(const Instance *instance, VkPhysicalDevice physDevice)
-    : m_instance(instance)
-    , m_physDevice(physDevice)
-    , m_queueFamilyIndex(findComputeQueueFamily(physDevice))
+template<typename T, PushConstantData PushConstants>
+Ticket Program::dispatchIndirectAsync(const Bindings &bindings, const PushConstants &pushConstants,
+                                      const Buffer<T> &buffer, std::size_t offset) const
 {
-    if (m_queueFamilyIndex != ~0u)
-    {
-        const float queuePriority = 1.0F;
-        const VkDeviceQueueCreateInfo deviceQueueCreateInfo = {.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-                                                               .pNext = nullptr,
-                                                               .flags = 0,
-                                                               .queueFamilyIndex = m_queueFamilyIndex,
-                                                               .queueCount = 1,
-                                                               .pQueuePriorities = &queuePriority};
+    return submitDispatch(bindings, std::as_bytes(std::span(&pushConstants, 1)),
+                          {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)});
+}
 
-        const VkDeviceCreateInfo deviceCreateInfo = {.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-                                                     .pNext = nullptr,
-                                                     .flags = 0,
-                                                     .queueCreateInfoCount = 1,
-                                                     .pQueueCreateInfos = &deviceQueueCreateInfo,
-                                                     .enabledLayerCount = 0,
-                                                     .ppEnabledLayerNames = nullptr,
-                                                     .enabledExtensionCount = 0,
-                                                     .ppEnabledExtensionNames = nullptr,
-                                                     .pEnabledFeatures = nullptr};
+void Program::enableTimestamps()
+{
+    if (m_queries.timestampPool || m_device->timestampValidBits() == 0)
+        return;
+
+    const VkQueryPoolCreateInfo queryPoolCreateInfo = {.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                                       .pNext = nullptr,
+                                                       .flags = 0,
+                                                       .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                                                       .queryCount = 2 * QuerySlotCount,
+                                                       .pipelineStatistics = 0};
+    VK_CHECK(vkCreateQueryPool(*m_device, &queryPoolCreateInfo, nullptr, &m_queries.timestampPool));
+    resetStats();
+}
 
-        VK_CHECK(vkCreateDevice(m_physDevice, &deviceCreateInfo, nullptr, &m_device));
+void Program::enablePipelineStatistics()
+{
+    if (m_queries.statisticsPool || !m_device->hasPipelineStatistics())
+        return;
 
-        const VkCommandPoolCreateInfo commandPoolCreateInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-                                                               .pNext = nullptr,
-                                                               .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-                                                               .queueFamilyIndex = m_queueFamilyIndex};
+    const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+        .queryCount = QuerySlotCount,
+        .pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT};
+    VK_CHECK(vkCreateQueryPool(*m_device, &queryPoolCreateInfo, nullptr, &m_queries.statisticsPool));
+    resetStats();
+}
+
+ProgramStats Program::stats() const
+{
+    for (std::uint32_t slot = 0; slot < m_queries.slots.size(); ++slot)
+    {
+        if (m_queries.slots[slot] && m_queries.slots[slot].isReady())
+            collectQueries(slot);
+    }
+    return m_queries.stats;
+}
 
-        VK_CHECK(vkCreateCommandPool(m_device, &commandPoolCreateInfo, nullptr, &m_commandPool));
+void Program::resetStats()
+{
+    // results of queries that are still in flight would mix the old and new query setup
+    for (const auto &ticket : m_queries.slots)
+        ticket.wait();
+    m_queries.slots.assign(QuerySlotCount, {});
+    m_queries.stats = {};
+}
 
-        const VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+Ticket Program::submitDispatch(const Bindings &bindings, std::span<const std::byte> pushConstants,
+                               const GroupCount &groupCount) const
+{
+    // separate submissions on a queue aren't ordered, so group counts written by an earlier dispatch or transfer
+    // need a barrier before they can be read
+    const auto waitForGroupCount = [&](VkCommandBuffer commandBuffer) {
+        if (!groupCount.indirectBuffer)
+            return;
+        const VkMemoryBarrier memoryBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
             .pNext = nullptr,
-            .commandPool = m_commandPool,
-            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = 1,
-        };
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    };
 
-        VK_CHECK(vkAllocateCommandBuffers(m_device, &commandBufferAllocateInfo, &m_commandBuffer));
+    if (!m_queries.timestampPool && !m_queries.statisticsPool)
+    {
+        return m_device->submit([&](VkCommandBuffer commandBuffer) {
+            waitForGroupCount(commandBuffer);
+            record(commandBuffer, bindings, pushConstants, groupCount);
+        });
+    }
 
-        vkGetDeviceQueue(m_device, m_queueFamilyIndex, 0, &m_computeQueue);
+    // the oldest slot is recycled, waiting for its results if they haven't come in yet
+    const auto slot = m_queries.nextSlot++ % QuerySlotCount;
+    if (m_queries.slots[slot])
+    {
+        m_queries.slots[slot].wait();
+        collectQueries(slot);
     }
+
+    const auto ticket = m_device->submit([&](VkCommandBuffer commandBuffer) {
+        waitForGroupCount(commandBuffer);
+        if (m_queries.timestampPool)
+        {
+            vkCmdResetQueryPool(commandBuffer, m_queries.timestampPool, 2 * slot, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queries.timestampPool, 2 * slot);
+        }
+        if (m_queries.statisticsPool)
+        {
+            vkCmdResetQueryPool(commandBuffer, m_queries.statisticsPool, slot, 1);
+            vkCmdBeginQuery(commandBuffer, m_queries.statisticsPool, slot, 0);
+        }
+
+        record(commandBuffer, bindings, pushConstants, groupCount);
+
+        if (m_queries.statisticsPool)
+            vkCmdEndQuery(commandBuffer, m_queries.statisticsPool, slot);
+        if (m_queries.timestampPool)
+        {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queries.timestampPool,
+                                2 * slot + 1);
+        }
+    });
+    m_queries.slots[slot] = ticket;
+
+    return ticket;
 }
 
-Device::~Device()
+void Program::collectQueries(std::uint32_t slot) const
 {
-    if (m_commandBuffer)
-        vkFreeCommandBuffers(m_device, m_commandPool, 1, &m_commandBuffer);
+    m_queries.slots[slot] = {};
+    auto &stats = m_queries.stats;
 
-    if (m_commandPool)
-        vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+    if (m_queries.timestampPool)
+    {
+        std::array<std::uint64_t, 2> timestamps{};
+        VK_CHECK(vkGetQueryPoolResults(*m_device, m_queries.timestampPool, 2 * slot, 2, sizeof(timestamps),
+                                       timestamps.data(), sizeof(std::uint64_t), VK_QUERY_RESULT_64_BIT));
+
+        const auto validBits = m_device->timestampValidBits();
+        const auto mask = validBits < 64 ? (std::uint64_t(1) << validBits) - 1 : ~std::uint64_t(0);
+        const auto ticks = (timestamps[1] - timestamps[0]) & mask;
+        const double nanoseconds = static_cast<double>(ticks) * m_device->properties().limits.timestampPeriod;
+
+        stats.minNanoseconds =
+            stats.timedDispatches == 0 ? nanoseconds : std::min(stats.minNanoseconds, nanoseconds);
+        stats.maxNanoseconds = std::max(stats.maxNanoseconds, nanoseconds);
+        stats.totalNanoseconds += nanoseconds;
+        ++stats.timedDispatches;
+    }
 
-    if (m_device)
-        vkDestroyDevice(m_device, nullptr);
+    if (m_queries.statisticsPool)
+    {
+        std::uint64_t invocations = 0;
+        VK_CHECK(vkGetQueryPoolResults(*m_device, m_queries.statisticsPool, slot, 1, sizeof(invocations),
+                                       &invocations, sizeof(std::uint64_t), VK_QUERY_RESULT_64_BIT));
+
+        stats.minInvocations =
+            stats.countedDispatches == 0 ? invocations : std::min(stats.minInvocations, invocations);
+        stats.maxInvocations = std::max(stats.maxInvocations, invocations);
+        stats.totalInvocations += invocations;
+        ++stats.countedDispatches;
+    }
 }
 
-Device::Device(Device &&rhs)
-    : m_instance(std::exchange(rhs.m_instance, nullptr))
-    , m_physDevice(std::exchange(rhs.m_physDevice, VK_NULL_HANDLE))
-    , m_queueFamilyIndex(std::exchange(rhs.m_queueFamilyIndex, ~0u))
-    , m_device(std::exchange(rhs.m_device, VK_NULL_HANDLE))
-    , m_commandPool(std::exchange(rhs.m_commandPool, VK_NULL_HANDLE))
+void Program::record(VkCommandBuffer commandBuffer, const Bindings &bindings, std::span<const std::byte> pushConstants,
+                     const GroupCount &groupCount) const
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    if (m_pushDescriptors)
+    {
+        const auto writeDescriptorSets = makeWriteDescriptorSets(VK_NULL_HANDLE, bindings.m_bufferInfos);
+        m_device->pushDescriptorSet(commandBuffer, m_pipelineLayout, writeDescriptorSets);
+    }
+    else if (m_bindingCount > 0)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1,
+                                &bindings.m_descriptorSet, 0, nullptr);
+    }
+    if (!pushConstants.empty())
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstants.size(),
+                           pushConstants.data());
+    if (groupCount.indirectBuffer)
+        vkCmdDispatchIndirect(commandBuffer, groupCount.indirectBuffer, groupCount.indirectOffset);
+    else
+        vkCmdDispatch(commandBuffer, groupCount.x, groupCount.y, groupCount.z);
+}
+
+Sequence::Sequence(const Device *device)
+    : m_device(device)
+{
+    const VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .commandPool = m_device->computeQueue()->commandPool(),
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    VK_CHECK(vkAllocateCommandBuffers(*m_device, &commandBufferAllocateInfo, &m_commandBuffer));
+
+    begin();
+}
+
+Sequence::~Sequence()
+{
+    if (m_commandBuffer)
+    {
+        m_lastSubmission.wait();
+        vkFreeCommandBuffers(*m_device, m_device->computeQueue()->commandPool(), 1, &m_commandBuffer);
+    }
+}
+
+Sequence::Sequence(Sequence &&rhs)
+    : m_device(std::exchange(rhs.m_device, nullptr))
     , m_commandBuffer(std::exchange(rhs.m_commandBuffer, VK_NULL_HANDLE))
-    , m_computeQueue(std::exchange(rhs.m_computeQueue, VK_NULL_HANDLE))
+    , m_lastSubmission(std::exchange(rhs.m_lastSubmission, {}))
 {
 }
 
-Device &Device::operator=(Device &&rhs)
+Sequence &Sequence::operator=(Sequence &&rhs)
 {
-    Device temp(std::move(rhs));
+    Sequence temp(std::move(rhs));
     swap(*this, temp);
     return *this;
 }
 
-std::uint32_t Device::findHostVisibleMemory(VkDeviceSize size) const
+void Sequence::begin()
 {
-    VkPhysicalDeviceMemoryProperties memoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(m_physDevice, &memoryProperties);
+    // simultaneous use so that the sequence can be resubmitted before the previous submission has finished
+    const VkCommandBufferBeginInfo commandBufferBeginInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                                             .pNext = nullptr,
+                                                             .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+                                                             .pInheritanceInfo = nullptr};
+    VK_CHECK(vkBeginCommandBuffer(m_commandBuffer, &commandBufferBeginInfo));
+}
 
-    for (std::uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-    {
-        const VkMemoryType &memoryType = memoryProperties.memoryTypes[i];
-        const auto flags = memoryType.propertyFlags;
-        if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
-        {
-            const auto &heap = memoryProperties.memoryHeaps[memoryType.heapIndex];
-            if (size <= heap.size)
-                return i;
-        }
-    }
+void Sequence::dispatch(const Program &program, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    program.record(m_commandBuffer, program.m_bindings, {}, {groupCountX, groupCountY, groupCountZ});
+}
 
-    return ~0u;
+template<PushConstantData PushConstants>
+void Sequence::dispatch(const Program &program, const PushConstants &pushConstants, uint32_t groupCountX,
+                        uint32_t groupCountY, uint32_t groupCountZ)
+{
+    program.record(m_commandBuffer, program.m_bindings, std::as_bytes(std::span(&pushConstants, 1)),
+                   {groupCountX, groupCountY, groupCountZ});
 }
 
-Instance::Instance()
+void Sequence::dispatch(const Program &program, const Bindings &bindings, uint32_t groupCountX, uint32_t groupCountY,
+                        uint32_t groupCountZ)
 {
-    const VkApplicationInfo applicationInfo = {.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-                                               .pNext = nullptr,
-                                               .pApplicationName = "test",
-                                               .applicationVersion = 0,
-                                               .pEngineName = "test",
-                                               .engineVersion = 0,
-                                               .apiVersion = VK_API_VERSION_1_3};
+    program.record(m_commandBuffer, bindings, {}, {groupCountX, groupCountY, groupCountZ});
+}
 
-    const auto layers = std::array{"VK_LAYER_KHRONOS_validation"};
-    const VkInstanceCreateInfo instanceCreateInfo = {.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-                                                     .pNext = nullptr,
-                                                     .flags = 0,
-                                                     .pApplicationInfo = &applicationInfo,
-                                                     .enabledLayerCount = layers.size(),
-                                                     .ppEnabledLayerNames = layers.data(),
-                                                     .enabledExtensionCount = 0,
-                                                     .ppEnabledExtensionNames = nullptr};
+template<PushConstantData PushConstants>
+void Sequence::dispatch(const Program &program, const Bindings &bindings, const PushConstants &pushConstants,
+                        uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    program.record(m_commandBuffer, bindings, std::as_bytes(std::span(&pushConstants, 1)),
+                   {groupCountX, groupCountY, groupCountZ});
+}
 
-    VK_CHECK(vkCreateInstance(&instanceCreateInfo, nullptr, &m_instance));
+template<typename T>
+void Sequence::dispatchIndirect(const Program &program, const Buffer<T> &buffer, std::size_t offset)
+{
+    program.record(m_commandBuffer, program.m_bindings, {},
+                   {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)});
 }
 
-Instance::~Instance()
+template<typename T, PushConstantData PushConstants>
+void Sequence::dispatchIndirect(const Program &program, const PushConstants &pushConstants, const Buffer<T> &buffer,
+                                std::size_t offset)
 {
-    if (m_instance)
-        vkDestroyInstance(m_instance, nullptr);
+    program.record(m_commandBuffer, program.m_bindings, std::as_bytes(std::span(&pushConstants, 1)),
+                   {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)});
 }
 
-Instance::Instance(Instance &&rhs)
-    : m_instance(std::exchange(rhs.m_instance, VK_NULL_HANDLE))
+template<typename T>
+void Sequence::dispatchIndirect(const Program &program, const Bindings &bindings, const Buffer<T> &buffer,
+                                std::size_t offset)
 {
+    program.record(m_commandBuffer, bindings, {}, {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)});
 }
 
-Instance &Instance::operator=(Instance &&rhs)
+template<typename T, PushConstantData PushConstants>
+void Sequence::dispatchIndirect(const Program &program, const Bindings &bindings, const PushConstants &pushConstants,
+                                const Buffer<T> &buffer, std::size_t offset)
 {
-    Instance temp(std::move(rhs));
-    swap(*this, temp);
-    return *this;
+    program.record(m_commandBuffer, bindings, std::as_bytes(std::span(&pushConstants, 1)),
+                   {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)});
 }
 
-std::vector<Device> Instance::devices() const
+void Sequence::barrier()
 {
-    uint32_t physDeviceCount = 0;
-    VK_CHECK(vkEnumeratePhysicalDevices(m_instance, &physDeviceCount, nullptr));
+    const VkMemoryBarrier memoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT |
+                         VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT};
+    const VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    const VkPipelineStageFlags dstStages = srcStages | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    vkCmdPipelineBarrier(m_commandBuffer, srcStages, dstStages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
 
-    std::vector<VkPhysicalDevice> physDevices(physDeviceCount);
-    VK_CHECK(vkEnumeratePhysicalDevices(m_instance, &physDeviceCount, physDevices.data()));
+template<typename T>
+void Sequence::copy(const Buffer<T> &source, const Buffer<T> &destination)
+{
+    const VkBufferCopy region = {
+        .srcOffset = 0, .dstOffset = 0, .size = std::min(source.size(), destination.size()) * sizeof(T)};
+    vkCmdCopyBuffer(m_commandBuffer, source, destination, 1, &region);
+}
+
+template<typename T>
+void Sequence::copy(const Buffer<T> &source, const Buffer<T> &destination, std::size_t sourceOffset,
+                    std::size_t destinationOffset, std::size_t count)
+{
+    const VkBufferCopy region = {
+        .srcOffset = sourceOffset * sizeof(T),
+        .dstOffset = destinationOffset * sizeof(T),
+        .size = std::min(source.byteCount(sourceOffset, count), destination.byteCount(destinationOffset, count))};
+    if (region.size > 0)
+        vkCmdCopyBuffer(m_commandBuffer, source, destination, 1, &region);
+}
+
+template<typename T>
+void Sequence::fill(const Buffer<T> &buffer, std::uint32_t value, std::size_t offset, std::size_t count)
+{
+    const auto sizeInBytes = buffer.fillRange(offset, count);
+    if (sizeInBytes > 0)
+        vkCmdFillBuffer(m_commandBuffer, buffer, offset * sizeof(T), sizeInBytes, value);
+}
+
+template<typename T>
+void Sequence::update(const Buffer<T> &buffer, std::span<const T> data, std::size_t offset)
+{
+    const auto sizeInBytes = buffer.updateRange(offset, data.size());
+    if (sizeInBytes > 0)
+        vkCmdUpdateBuffer(m_commandBuffer, buffer, offset * sizeof(T), sizeInBytes, data.data());
+}
+
+void Sequence::end()
+{
+    VK_CHECK(vkEndCommandBuffer(m_commandBuffer));
+}
+
+void Sequence::reset()
+{
+    m_lastSubmission.wait();
+    VK_CHECK(vkResetCommandBuffer(m_commandBuffer, 0));
+    begin();
+}
+
+Ticket Sequence::submit()
+{
+    m_lastSubmission = m_device->computeQueue()->submit(m_commandBuffer);
+    return m_lastSubmission;
+}
+
+void Sequence::run()
+{
+    submit().wait();
+}
+
+void TaskGraph::dispatch(const Program &program, const Access &access, uint32_t groupCountX, uint32_t groupCountY,
+                         uint32_t groupCountZ)
+{
+    addNode(program, nullptr, {}, {groupCountX, groupCountY, groupCountZ}, access);
+}
+
+template<PushConstantData PushConstants>
+void TaskGraph::dispatch(const Program &program, const PushConstants &pushConstants, const Access &access,
+                         uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    addNode(program, nullptr, std::as_bytes(std::span(&pushConstants, 1)), {groupCountX, groupCountY, groupCountZ},
+            access);
+}
+
+void TaskGraph::dispatch(const Program &program, const Bindings &bindings, const Access &access, uint32_t groupCountX,
+                         uint32_t groupCountY, uint32_t groupCountZ)
+{
+    addNode(program, &bindings, {}, {groupCountX, groupCountY, groupCountZ}, access);
+}
+
+template<PushConstantData PushConstants>
+void TaskGraph::dispatch(const Program &program, const Bindings &bindings, const PushConstants &pushConstants,
+                         const Access &access, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ)
+{
+    addNode(program, &bindings, std::as_bytes(std::span(&pushConstants, 1)), {groupCountX, groupCountY, groupCountZ},
+            access);
+}
+
+template<typename T>
+void TaskGraph::dispatchIndirect(const Program &program, const Access &access, const Buffer<T> &buffer,
+                                 std::size_t offset)
+{
+    addNode(program, nullptr, {}, {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)}, access);
+}
+
+template<typename T, PushConstantData PushConstants>
+void TaskGraph::dispatchIndirect(const Program &program, const PushConstants &pushConstants, const Access &access,
+                                 const Buffer<T> &buffer, std::size_t offset)
+{
+    addNode(program, nullptr, std::as_bytes(std::span(&pushConstants, 1)),
+            {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)}, access);
+}
+
+template<typename T>
+void TaskGraph::dispatchIndirect(const Program &program, const Bindings &bindings, const Access &access,
+                                 const Buffer<T> &buffer, std::size_t offset)
+{
+    addNode(program, &bindings, {}, {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)}, access);
+}
+
+template<typename T, PushConstantData PushConstants>
+void TaskGraph::dispatchIndirect(const Program &program, const Bindings &bindings, const PushConstants &pushConstants,
+                                 const Access &access, const Buffer<T> &buffer, std::size_t offset)
+{
+    addNode(program, &bindings, std::as_bytes(std::span(&pushConstants, 1)),
+            {.indirectBuffer = buffer, .indirectOffset = offset * sizeof(T)}, access);
+}
+
+void TaskGraph::addNode(const Program &program, const Bindings *bindings, std::span<const std::byte> pushConstants,
+                        const Program::GroupCount &groupCount, const Access &access)
+{
+    Node node{.program = &program,
+              .bindings = bindings,
+              .pushConstants = {pushConstants.begin(), pushConstants.end()},
+              .groupCount = groupCount,
+              .access = access};
+    if (groupCount.indirectBuffer)
+        node.access.reads.push_back(groupCount.indirectBuffer);
+    m_nodes.push_back(std::move(node));
+}
+
+bool TaskGraph::dependsOn(const Node &node, const Node &earlier)
+{
+    const auto intersects = [](const std::vector<VkBuffer> &lhs, const std::vector<VkBuffer> &rhs) -> bool {
+        return std::ranges::any_of(lhs,
+                                   [&rhs](VkBuffer buffer) { return std::ranges::find(rhs, buffer) != rhs.end(); });
+    };
+    return intersects(node.access.reads, earlier.access.writes) ||
+           intersects(node.access.writes, earlier.access.reads) ||
+           intersects(node.access.writes, earlier.access.writes);
+}
+
+void TaskGraph::record(Sequence &sequence) const
+{
+    // each node goes one level past the deepest earlier node it depends on
+    std::vector<std::size_t> levels(m_nodes.size(), 0);
+    std::size_t levelCount = 0;
+    for (std::size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        for (std::size_t j = 0; j < i; ++j)
+        {
+            if (levels[j] >= levels[i] && dependsOn(m_nodes[i], m_nodes[j]))
+                levels[i] = levels[j] + 1;
+        }
+        levelCount = std::max(levelCount, levels[i] + 1);
+    }
+
+    for (std::size_t level = 0; level < levelCount; ++level)
+    {
+        if (level > 0)
+        {
+            bool indirect = false;
+            for (std::size_t i = 0; i < m_nodes.size(); ++i)
+                indirect = indirect || (levels[i] == level && m_nodes[i].groupCount.indirectBuffer);
+            recordBarrier(sequence, indirect);
+        }
+        for (std::size_t i = 0; i < m_nodes.size(); ++i)
+        {
+            if (levels[i] != level)
+                continue;
+            const auto &node = m_nodes[i];
+            node.program->record(sequence, node.bindings ? *node.bindings : node.program->m_bindings,
+                                 node.pushConstants, node.groupCount);
+        }
+    }
+}
+
+// Every barrier makes all shader writes so far available, so a level only needs to make them visible to itself even
+// when it depends on a node several levels back.
+void TaskGraph::recordBarrier(const Sequence &sequence, bool indirect)
+{
+    if (sequence.m_device->hasSynchronization2())
+    {
+        const VkMemoryBarrier2 memoryBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+            .pNext = nullptr,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            .srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            .dstStageMask =
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | (indirect ? VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT : 0),
+            .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+                             (indirect ? VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT : 0)};
+        const VkDependencyInfo dependencyInfo = {.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+                                                 .pNext = nullptr,
+                                                 .dependencyFlags = 0,
+                                                 .memoryBarrierCount = 1,
+                                                 .pMemoryBarriers = &memoryBarrier,
+                                                 .bufferMemoryBarrierCount = 0,
+                                                 .pBufferMemoryBarriers = nullptr,
+                                                 .imageMemoryBarrierCount = 0,
+                                                 .pImageMemoryBarriers = nullptr};
+        vkCmdPipelineBarrier2(sequence, &dependencyInfo);
+    }
+    else
+    {
+        const VkMemoryBarrier memoryBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+                             (indirect ? VK_ACCESS_INDIRECT_COMMAND_READ_BIT : 0u)};
+        const VkPipelineStageFlags dstStages =
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | (indirect ? VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT : 0u);
+        vkCmdPipelineBarrier(sequence, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0, 1, &memoryBarrier, 0,
+                             nullptr, 0, nullptr);
+    }
+}
+
+MultiDeviceExecutor::MultiDeviceExecutor(std::span<Device> devices, std::uint64_t granularity,
+                                         std::uint64_t maxChunkSize, std::uint32_t maxInFlight)
+    : m_granularity(std::max<std::uint64_t>(granularity, 1))
+    , m_maxChunkSize(std::max(maxChunkSize / m_granularity, std::uint64_t{1}) * m_granularity)
+    , m_maxInFlight(std::max(maxInFlight, 1u))
+{
+    for (auto &device : devices)
+    {
+        if (device.computeQueue())
+            m_devices.push_back(&device);
+    }
+    m_throughput.assign(m_devices.size(), 0.0);
+}
+
+std::uint64_t MultiDeviceExecutor::chunkSize(std::size_t device) const
+{
+    // scale relative to the slowest device that has been measured, until then everybody gets the smallest chunk
+    double slowest = 0.0;
+    for (const auto throughput : m_throughput)
+    {
+        if (throughput > 0.0 && (slowest == 0.0 || throughput < slowest))
+            slowest = throughput;
+    }
+    if (slowest == 0.0 || m_throughput[device] == 0.0)
+        return m_granularity;
+
+    const auto scale = std::max<std::uint64_t>(1, std::llround(m_throughput[device] / slowest));
+    return std::min(scale, m_maxChunkSize / m_granularity) * m_granularity;
+}
+
+void MultiDeviceExecutor::run(std::uint64_t count, const Submit &submit, const Gather &gather)
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Chunk
+    {
+        std::uint64_t offset;
+        std::uint64_t count;
+        Ticket ticket;
+    };
+
+    struct State
+    {
+        std::deque<Chunk> inFlight;
+        std::uint64_t completed{0};
+        Clock::time_point start;
+    };
+
+    std::vector<State> states(m_devices.size());
+    m_throughput.assign(m_devices.size(), 0.0);
+
+    std::uint64_t next = 0;
+    bool busy = !m_devices.empty();
+    while (busy)
+    {
+        busy = false;
+        bool progress = false;
+        for (std::size_t device = 0; device < m_devices.size(); ++device)
+        {
+            auto &state = states[device];
+
+            while (!state.inFlight.empty() && state.inFlight.front().ticket.isReady())
+            {
+                const auto chunk = state.inFlight.front();
+                state.inFlight.pop_front();
+                gather(device, chunk.offset, chunk.count);
+
+                state.completed += chunk.count;
+                const std::chrono::duration<double> elapsed = Clock::now() - state.start;
+                if (elapsed.count() > 0.0)
+                    m_throughput[device] = static_cast<double>(state.completed) / elapsed.count();
+                progress = true;
+            }
+
+            while (state.inFlight.size() < m_maxInFlight && next < count)
+            {
+                if (state.completed == 0 && state.inFlight.empty())
+                    state.start = Clock::now();
+
+                const auto chunkCount = std::min(chunkSize(device), count - next);
+                state.inFlight.push_back({next, chunkCount, submit(device, next, chunkCount)});
+                next += chunkCount;
+                progress = true;
+            }
+
+            busy = busy || !state.inFlight.empty();
+        }
+
+        if (busy && !progress)
+        {
+            // block on the oldest submission instead of polling, but only briefly when other devices could finish
+            // first and be left idle
+            std::size_t oldest = m_devices.size();
+            std::size_t busyDevices = 0;
+            for (std::size_t device = 0; device < m_devices.size(); ++device)
+            {
+                if (states[device].inFlight.empty())
+                    continue;
+                ++busyDevices;
+                if (oldest == m_devices.size() ||
+                    states[device].inFlight.front().offset < states[oldest].inFlight.front().offset)
+                    oldest = device;
+            }
+            const auto &ticket = states[oldest].inFlight.front().ticket;
+            if (busyDevices == 1)
+                ticket.wait();
+            else
+                ticket.wait(MaxPollInterval);
+        }
+    }
+}
+
+template<typename T>
+Buffer<T>::Buffer(const Device *device, std::size_t size, MemoryUsage usage)
+    : m_device(device)
+    , m_sizeInBytes(size * sizeof(T))
+{
+    initBuffer(nullptr);
+
+    VkMemoryRequirements memoryRequirements{};
+    vkGetBufferMemoryRequirements(*m_device, m_buffer, &memoryRequirements);
+
+    const VkMemoryPropertyFlags memoryProperties =
+        usage == MemoryUsage::DeviceLocal ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+                                          : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    auto allocation = m_device->allocator()->allocate(memoryRequirements, memoryProperties);
+    if (!allocation.has_value())
+    {
+        vkDestroyBuffer(*m_device, std::exchange(m_buffer, VK_NULL_HANDLE), nullptr);
+        return;
+    }
+    m_allocation = *allocation;
+
+    VK_CHECK(vkBindBufferMemory(*m_device, m_buffer, m_allocation.memory, m_allocation.offset));
+}
+
+template<typename T>
+Buffer<T>::Buffer(const Device *device, std::span<const T> data, MemoryUsage usage)
+    : Buffer(device, data.size(), usage)
+{
+    upload(data);
+}
+
+template<typename T>
+Buffer<T>::Buffer(const Device *device, std::span<T> data, ImportHostMemory)
+    : m_device(device)
+    , m_sizeInBytes(data.size_bytes())
+{
+    const auto alignment = m_device->minImportedHostPointerAlignment();
+    const bool canImport = alignment != 0 && m_sizeInBytes != 0 &&
+                           reinterpret_cast<std::uintptr_t>(data.data()) % alignment == 0 &&
+                           m_sizeInBytes % alignment == 0;
+    if (canImport)
+    {
+        const VkExternalMemoryBufferCreateInfo externalMemoryBufferCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+            .pNext = nullptr,
+            .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT};
+        initBuffer(&externalMemoryBufferCreateInfo);
+
+        VkMemoryRequirements memoryRequirements{};
+        vkGetBufferMemoryRequirements(*m_device, m_buffer, &memoryRequirements);
+
+        // the import can't grow to a requirement the driver rounded up past the data
+        auto allocation = memoryRequirements.size <= m_sizeInBytes
+                              ? m_device->allocator()->importHostMemory(data.data(), m_sizeInBytes,
+                                                                        memoryRequirements.memoryTypeBits)
+                              : std::nullopt;
+        if (allocation.has_value())
+        {
+            m_allocation = *allocation;
+            m_hostImported = true;
+            VK_CHECK(vkBindBufferMemory(*m_device, m_buffer, m_allocation.memory, 0));
+            return;
+        }
+        vkDestroyBuffer(*m_device, std::exchange(m_buffer, VK_NULL_HANDLE), nullptr);
+    }
+
+    *this = Buffer(device, std::span<const T>(data));
+}
+
+template<typename T>
+void Buffer<T>::initBuffer(const void *next)
+{
+    // shared between the compute and transfer families so that no ownership transfers are needed
+    const auto queueFamilyIndices = m_device->queueFamilyIndices();
+    const VkBufferCreateInfo bufferCreateInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                                 .pNext = next,
+                                                 .flags = 0,
+                                                 .size = m_sizeInBytes,
+                                                 .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                          VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                                          VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                                          VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                                          (m_device->hasBufferDeviceAddress()
+                                                               ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                                                               : 0u),
+                                                 .sharingMode = queueFamilyIndices.size() > 1
+                                                                    ? VK_SHARING_MODE_CONCURRENT
+                                                                    : VK_SHARING_MODE_EXCLUSIVE,
+                                                 .queueFamilyIndexCount =
+                                                     static_cast<uint32_t>(queueFamilyIndices.size()),
+                                                 .pQueueFamilyIndices = queueFamilyIndices.data()};
+    VK_CHECK(vkCreateBuffer(*m_device, &bufferCreateInfo, nullptr, &m_buffer));
+}
+
+template<typename T>
+Buffer<T>::~Buffer()
+{
+    if (m_buffer)
+        vkDestroyBuffer(*m_device, m_buffer, nullptr);
+
+    if (m_allocation.memory)
+        m_device->allocator()->free(m_allocation);
+}
+
+template<typename T>
+Buffer<T>::Buffer(Buffer &&rhs)
+    : m_device(std::exchange(rhs.m_device, nullptr))
+    , m_sizeInBytes(std::exchange(rhs.m_sizeInBytes, 0))
+    , m_allocation(std::exchange(rhs.m_allocation, {}))
+    , m_buffer(std::exchange(rhs.m_buffer, VK_NULL_HANDLE))
+    , m_hostImported(std::exchange(rhs.m_hostImported, false))
+{
+}
+
+template<typename T>
+Buffer<T> &Buffer<T>::operator=(Buffer &&rhs)
+{
+    Buffer temp(std::move(rhs));
+    swap(*this, temp);
+    return *this;
+}
+
+template<typename T>
+std::span<T> Buffer<T>::map() const
+{
+    if (!isHostCoherent())
+        return {};
+    return {reinterpret_cast<T *>(m_allocation.mapped), m_sizeInBytes / sizeof(T)};
+}
+
+template<typename T>
+bool Buffer<T>::isHostCoherent() const
+{
+    // device-local memory can be mapped without being coherent, that goes through the staging path instead
+    return m_allocation.mapped && (m_device->allocator()->memoryPropertyFlags(m_allocation.memoryTypeIndex) &
+                                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+template<typename T>
+void Buffer<T>::unmap() const
+{
+    // Buffer memory is persistently mapped by the allocator, nothing to do here.
+}
+
+template<typename T>
+void Buffer<T>::upload(std::span<const T> data) const
+{
+    const auto sizeInBytes = std::min<VkDeviceSize>(data.size_bytes(), m_sizeInBytes);
+    if (sizeInBytes == 0)
+        return;
+
+    if (isHostCoherent())
+    {
+        std::memcpy(m_allocation.mapped, data.data(), sizeInBytes);
+        return;
+    }
+
+    // the staging pool waits for earlier chunks when it runs out of buffers, so copies overlap with transfers
+    auto *stagingPool = m_device->stagingPool();
+    const auto *bytes = reinterpret_cast<const std::byte *>(data.data());
+    Ticket ticket;
+    for (VkDeviceSize offset = 0; offset < sizeInBytes;)
+    {
+        const auto staging = stagingPool->acquire(sizeInBytes - offset);
+        const auto chunkSize = std::min(staging.size, sizeInBytes - offset);
+        std::memcpy(staging.allocation.mapped, bytes + offset, chunkSize);
+        ticket = m_device->submit([&](VkCommandBuffer commandBuffer) {
+            const VkBufferCopy region = {.srcOffset = 0, .dstOffset = offset, .size = chunkSize};
+            vkCmdCopyBuffer(commandBuffer, staging.buffer, m_buffer, 1, &region);
+
+            const VkMemoryBarrier memoryBarrier = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                                   .pNext = nullptr,
+                                                   .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                   .dstAccessMask =
+                                                       VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        });
+        stagingPool->release(staging, ticket);
+        offset += chunkSize;
+    }
+    ticket.wait();
+}
+
+template<typename T>
+Ticket Buffer<T>::uploadAsync(std::span<const T> data) const
+{
+    const auto sizeInBytes = std::min<VkDeviceSize>(data.size_bytes(), m_sizeInBytes);
+    if (sizeInBytes == 0)
+        return {};
+
+    if (isHostCoherent())
+    {
+        std::memcpy(m_allocation.mapped, data.data(), sizeInBytes);
+        return {};
+    }
+
+    auto *stagingPool = m_device->stagingPool();
+    auto *transferQueue = m_device->transferQueue();
+    auto *computeQueue = m_device->computeQueue();
+    const auto *bytes = reinterpret_cast<const std::byte *>(data.data());
+    // earlier copies to the buffer, and on a shared queue earlier dispatches, are only ordered by a barrier
+    const bool sharedQueue = transferQueue == computeQueue;
+    const VkPipelineStageFlags previousStages =
+        sharedQueue ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT
+                    : VK_PIPELINE_STAGE_TRANSFER_BIT;
+    const VkAccessFlags previousWrites = sharedQueue ? VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+                                                     : VK_ACCESS_TRANSFER_WRITE_BIT;
+    Ticket ticket;
+    for (VkDeviceSize offset = 0; offset < sizeInBytes;)
+    {
+        const auto staging = stagingPool->acquire(sizeInBytes - offset);
+        const auto chunkSize = std::min(staging.size, sizeInBytes - offset);
+        std::memcpy(staging.allocation.mapped, bytes + offset, chunkSize);
+        // pending dispatches may still use the buffer
+        transferQueue->addWait(computeQueue->lastSubmission());
+        ticket = transferQueue->submit([&](VkCommandBuffer commandBuffer) {
+            const VkMemoryBarrier writeBarrier = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                                  .pNext = nullptr,
+                                                  .srcAccessMask = previousWrites,
+                                                  .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT};
+            vkCmdPipelineBarrier(commandBuffer, previousStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &writeBarrier, 0,
+                                 nullptr, 0, nullptr);
+
+            const VkBufferCopy region = {.srcOffset = 0, .dstOffset = offset, .size = chunkSize};
+            vkCmdCopyBuffer(commandBuffer, staging.buffer, m_buffer, 1, &region);
+
+            // the semaphore wait covers this when the copy runs on its own queue
+            if (sharedQueue)
+            {
+                const VkMemoryBarrier memoryBarrier = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                                       .pNext = nullptr,
+                                                       .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                       .dstAccessMask =
+                                                           VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0,
+                                     nullptr);
+            }
+        });
+        stagingPool->release(staging, ticket);
+        offset += chunkSize;
+    }
+    // the last chunk's signal covers the earlier ones, they were submitted before it on the same queue
+    computeQueue->addWait(ticket);
+
+    return ticket;
+}
+
+template<typename T>
+std::vector<T> Buffer<T>::download() const
+{
+    std::vector<T> data(size());
+    if (data.empty())
+        return data;
+
+    if (isHostCoherent())
+    {
+        std::memcpy(data.data(), m_allocation.mapped, m_sizeInBytes);
+        return data;
+    }
+
+    // each chunk is copied out while the next one is transferred
+    struct Chunk
+    {
+        StagingBuffer staging;
+        VkDeviceSize offset{0};
+        VkDeviceSize size{0};
+        Ticket ticket;
+    };
+    auto *stagingPool = m_device->stagingPool();
+    auto *bytes = reinterpret_cast<std::byte *>(data.data());
+    const auto finish = [&](const Chunk &chunk) {
+        chunk.ticket.wait();
+        std::memcpy(bytes + chunk.offset, chunk.staging.allocation.mapped, chunk.size);
+        stagingPool->release(chunk.staging);
+    };
+    std::optional<Chunk> previous;
+    for (VkDeviceSize offset = 0; offset < m_sizeInBytes;)
+    {
+        Chunk chunk{.staging = stagingPool->acquire(m_sizeInBytes - offset), .offset = offset};
+        chunk.size = std::min(chunk.staging.size, m_sizeInBytes - offset);
+        chunk.ticket = m_device->submit([&](VkCommandBuffer commandBuffer) {
+            const VkMemoryBarrier shaderBarrier = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                                   .pNext = nullptr,
+                                                   .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                                   .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT};
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 0, 1, &shaderBarrier, 0, nullptr, 0, nullptr);
+
+            const VkBufferCopy region = {.srcOffset = chunk.offset, .dstOffset = 0, .size = chunk.size};
+            vkCmdCopyBuffer(commandBuffer, m_buffer, chunk.staging.buffer, 1, &region);
+
+            const VkMemoryBarrier hostBarrier = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                                 .pNext = nullptr,
+                                                 .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                 .dstAccessMask = VK_ACCESS_HOST_READ_BIT};
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                                 &hostBarrier, 0, nullptr, 0, nullptr);
+        });
+        offset += chunk.size;
+        if (previous)
+            finish(*previous);
+        previous = chunk;
+    }
+    finish(*previous);
+
+    return data;
+}
+
+template<typename T>
+void Buffer<T>::fill(std::uint32_t value, std::size_t offset, std::size_t count) const
+{
+    fillAsync(value, offset, count).wait();
+}
+
+template<typename T>
+Ticket Buffer<T>::fillAsync(std::uint32_t value, std::size_t offset, std::size_t count) const
+{
+    const auto sizeInBytes = fillRange(offset, count);
+    if (sizeInBytes == 0)
+        return {};
+
+    return submitTransfer([&](VkCommandBuffer commandBuffer) {
+        vkCmdFillBuffer(commandBuffer, m_buffer, offset * sizeof(T), sizeInBytes, value);
+    });
+}
+
+template<typename T>
+void Buffer<T>::copyTo(const Buffer &destination, std::size_t sourceOffset, std::size_t destinationOffset,
+                       std::size_t count) const
+{
+    copyToAsync(destination, sourceOffset, destinationOffset, count).wait();
+}
+
+template<typename T>
+Ticket Buffer<T>::copyToAsync(const Buffer &destination, std::size_t sourceOffset, std::size_t destinationOffset,
+                              std::size_t count) const
+{
+    const VkBufferCopy region = {
+        .srcOffset = sourceOffset * sizeof(T),
+        .dstOffset = destinationOffset * sizeof(T),
+        .size = std::min(byteCount(sourceOffset, count), destination.byteCount(destinationOffset, count))};
+    if (region.size == 0)
+        return {};
+
+    return submitTransfer([&](VkCommandBuffer commandBuffer) {
+        vkCmdCopyBuffer(commandBuffer, m_buffer, destination, 1, &region);
+    });
+}
+
+template<typename T>
+void Buffer<T>::update(std::span<const T> data, std::size_t offset) const
+{
+    updateAsync(data, offset).wait();
+}
+
+template<typename T>
+Ticket Buffer<T>::updateAsync(std::span<const T> data, std::size_t offset) const
+{
+    const auto sizeInBytes = updateRange(offset, data.size());
+    if (sizeInBytes == 0)
+        return {};
+
+    return submitTransfer([&](VkCommandBuffer commandBuffer) {
+        vkCmdUpdateBuffer(commandBuffer, m_buffer, offset * sizeof(T), sizeInBytes, data.data());
+    });
+}
+
+template<typename T>
+VkDeviceSize Buffer<T>::byteCount(std::size_t offset, std::size_t count) const
+{
+    if (offset >= size())
+        return 0;
+    return std::min(count, size() - offset) * sizeof(T);
+}
+
+template<typename T>
+VkDeviceSize Buffer<T>::fillRange(std::size_t offset, std::size_t count) const
+{
+    auto sizeInBytes = byteCount(offset, count);
+    // like VK_WHOLE_SIZE, a fill up to the end skips a trailing partial word
+    if (count == WholeSize)
+        sizeInBytes &= ~VkDeviceSize(3);
+    if ((offset * sizeof(T)) % 4 != 0 || sizeInBytes % 4 != 0)
+    {
+        std::fprintf(stderr, "Buffer fill of %lu bytes at byte offset %lu is not 4-byte aligned\n", sizeInBytes,
+                     offset * sizeof(T));
+        std::exit(EXIT_FAILURE);
+    }
+    return sizeInBytes;
+}
+
+template<typename T>
+VkDeviceSize Buffer<T>::updateRange(std::size_t offset, std::size_t count) const
+{
+    const auto sizeInBytes = byteCount(offset, count);
+    if ((offset * sizeof(T)) % 4 != 0 || sizeInBytes % 4 != 0 || sizeInBytes > MaxUpdateSize)
+    {
+        std::fprintf(stderr, "Buffer update of %lu bytes at byte offset %lu is not 4-byte aligned or over %lu bytes\n",
+                     sizeInBytes, offset * sizeof(T), MaxUpdateSize);
+        std::exit(EXIT_FAILURE);
+    }
+    return sizeInBytes;
+}
+
+template<typename T>
+Ticket Buffer<T>::submitTransfer(const std::function<void(VkCommandBuffer)> &record) const
+{
+    // barriers on both sides, so the transfer needs no explicit synchronization with the dispatches around it
+    return m_device->submit([&](VkCommandBuffer commandBuffer) {
+        const VkMemoryBarrier shaderBarrier = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                                               .pNext = nullptr,
+                                               .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                                               .dstAccessMask =
+                                                   VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1,
+                             &shaderBarrier, 0, nullptr, 0, nullptr);
+
+        record(commandBuffer);
+
+        const VkMemoryBarrier transferBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = nullptr,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+                             VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                                 VK_PIPELINE_STAGE_HOST_BIT,
+                             0, 1, &transferBarrier, 0, nullptr, 0, nullptr);
+    });
+}
+
+template<typename T>
+std::size_t Buffer<T>::viewAlignment(const Device *device)
+{
+    const auto alignment = device->properties().limits.minStorageBufferOffsetAlignment;
+    return alignment / std::gcd(alignment, sizeof(T));
+}
+
+template<typename T>
+BufferView<T>::BufferView(const Buffer<T> &buffer, std::size_t offset, std::size_t count)
+    : m_buffer(buffer)
+    , m_offset(offset)
+    , m_count(buffer.byteCount(offset, count) / sizeof(T))
+{
+    const auto alignment = Buffer<T>::viewAlignment(buffer.m_device);
+    if (offset % alignment != 0)
+    {
+        std::fprintf(stderr, "Buffer view offset %lu is not a multiple of %lu elements\n", offset, alignment);
+        std::exit(EXIT_FAILURE);
+    }
+    if (m_count == 0)
+    {
+        std::fprintf(stderr, "Buffer view at offset %lu has no elements\n", offset);
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+template<typename T>
+VkDeviceAddress Buffer<T>::deviceAddress() const
+{
+    const VkBufferDeviceAddressInfo bufferDeviceAddressInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .pNext = nullptr, .buffer = m_buffer};
+    return vkGetBufferDeviceAddress(*m_device, &bufferDeviceAddressInfo);
+}
+
+Device::Device(const Instance *instance, VkPhysicalDevice physDevice)
+    : m_instance(instance)
+    , m_physDevice(physDevice)
+{
+    const auto queueFamilyProperties = queueFamilies(m_physDevice);
+    m_queueFamilyIndex =
+        findQueueFamily(queueFamilyProperties, [](VkQueueFlags flags) { return (flags & VK_QUEUE_COMPUTE_BIT) != 0; });
+
+    vkGetPhysicalDeviceProperties(m_physDevice, &m_properties);
+
+    m_subgroupSizeControlProperties = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES,
+                                       .pNext = nullptr};
+    m_subgroupProperties = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+                            .pNext = m_properties.apiVersion >= VK_API_VERSION_1_3 ? &m_subgroupSizeControlProperties
+                                                                                   : nullptr};
+    if (m_properties.apiVersion >= VK_API_VERSION_1_1)
+    {
+        VkPhysicalDeviceProperties2 properties2 = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                                                   .pNext = &m_subgroupProperties};
+        vkGetPhysicalDeviceProperties2(m_physDevice, &properties2);
+    }
+    m_subgroupProperties.pNext = nullptr;
+
+    if (m_queueFamilyIndex != ~0u)
+    {
+        m_timestampValidBits = queueFamilyProperties[m_queueFamilyIndex].timestampValidBits;
+
+        const auto extensions = supportedDeviceExtensions(m_physDevice);
+        std::vector<const char *> enabledExtensions;
+        if (extensions.contains(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME))
+            enabledExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+        // builds on external memory, which is core in 1.1
+        const bool externalMemoryHost = m_properties.apiVersion >= VK_API_VERSION_1_1 &&
+                                        extensions.contains(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+        if (externalMemoryHost)
+            enabledExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+
+        VkPhysicalDeviceFeatures supportedFeatures10{};
+        vkGetPhysicalDeviceFeatures(m_physDevice, &supportedFeatures10);
+
+        VkPhysicalDeviceFeatures enabledFeatures10{};
+        enabledFeatures10.pipelineStatisticsQuery = supportedFeatures10.pipelineStatisticsQuery;
+        m_pipelineStatistics = enabledFeatures10.pipelineStatisticsQuery;
+
+        const bool hasVulkan13 = m_properties.apiVersion >= VK_API_VERSION_1_3;
+
+        VkPhysicalDeviceVulkan13Features supportedFeatures13 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES, .pNext = nullptr};
+        VkPhysicalDeviceVulkan12Features supportedFeatures12 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+            .pNext = hasVulkan13 ? &supportedFeatures13 : nullptr};
+        VkPhysicalDeviceFeatures2 supportedFeatures = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                                                       .pNext = &supportedFeatures12};
+        if (m_properties.apiVersion >= VK_API_VERSION_1_2)
+            vkGetPhysicalDeviceFeatures2(m_physDevice, &supportedFeatures);
+
+        VkPhysicalDeviceVulkan13Features enabledFeatures13 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES, .pNext = nullptr};
+        enabledFeatures13.subgroupSizeControl = supportedFeatures13.subgroupSizeControl;
+        enabledFeatures13.computeFullSubgroups = supportedFeatures13.computeFullSubgroups;
+        m_subgroupSizeControl =
+            enabledFeatures13.subgroupSizeControl &&
+            (m_subgroupSizeControlProperties.requiredSubgroupSizeStages & VK_SHADER_STAGE_COMPUTE_BIT);
+        m_computeFullSubgroups = enabledFeatures13.computeFullSubgroups;
+        enabledFeatures13.synchronization2 = supportedFeatures13.synchronization2;
+        m_synchronization2 = enabledFeatures13.synchronization2;
+
+        VkPhysicalDeviceVulkan12Features enabledFeatures12 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+            .pNext = hasVulkan13 ? &enabledFeatures13 : nullptr};
+        enabledFeatures12.bufferDeviceAddress = supportedFeatures12.bufferDeviceAddress;
+        enabledFeatures12.timelineSemaphore = supportedFeatures12.timelineSemaphore;
+        m_bufferDeviceAddress = enabledFeatures12.bufferDeviceAddress;
+
+        // A family that can only do transfers, usually backed by a DMA engine that runs alongside the compute units.
+        // A separate transfer queue needs timeline semaphores to synchronize with the compute queue.
+        if (enabledFeatures12.timelineSemaphore)
+        {
+            m_transferQueueFamilyIndex = findQueueFamily(queueFamilyProperties, [](VkQueueFlags flags) {
+                return (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+            });
+        }
+
+        const float queuePriority = 1.0F;
+        std::vector<VkDeviceQueueCreateInfo> deviceQueueCreateInfos;
+        for (const auto queueFamilyIndex : queueFamilyIndices())
+        {
+            deviceQueueCreateInfos.push_back({.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                                              .pNext = nullptr,
+                                              .flags = 0,
+                                              .queueFamilyIndex = queueFamilyIndex,
+                                              .queueCount = 1,
+                                              .pQueuePriorities = &queuePriority});
+        }
+
+        const VkDeviceCreateInfo deviceCreateInfo = {.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+                                                     .pNext = m_properties.apiVersion >= VK_API_VERSION_1_2
+                                                                  ? &enabledFeatures12
+                                                                  : nullptr,
+                                                     .flags = 0,
+                                                     .queueCreateInfoCount =
+                                                         static_cast<uint32_t>(deviceQueueCreateInfos.size()),
+                                                     .pQueueCreateInfos = deviceQueueCreateInfos.data(),
+                                                     .enabledLayerCount = 0,
+                                                     .ppEnabledLayerNames = nullptr,
+                                                     .enabledExtensionCount =
+                                                         static_cast<uint32_t>(enabledExtensions.size()),
+                                                     .ppEnabledExtensionNames = enabledExtensions.data(),
+                                                     .pEnabledFeatures = &enabledFeatures10};
+
+        VK_CHECK(vkCreateDevice(m_physDevice, &deviceCreateInfo, nullptr, &m_device));
+
+        if (extensions.contains(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME))
+        {
+            VkPhysicalDevicePushDescriptorPropertiesKHR pushDescriptorProperties = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR, .pNext = nullptr};
+            VkPhysicalDeviceProperties2 properties2 = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                                                       .pNext = &pushDescriptorProperties};
+            vkGetPhysicalDeviceProperties2(m_physDevice, &properties2);
+
+            m_maxPushDescriptors = pushDescriptorProperties.maxPushDescriptors;
+            m_cmdPushDescriptorSet = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(
+                vkGetDeviceProcAddr(m_device, "vkCmdPushDescriptorSetKHR"));
+        }
+
+        if (externalMemoryHost)
+        {
+            VkPhysicalDeviceExternalMemoryHostPropertiesEXT externalMemoryHostProperties = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT, .pNext = nullptr};
+            VkPhysicalDeviceProperties2 properties2 = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                                                       .pNext = &externalMemoryHostProperties};
+            vkGetPhysicalDeviceProperties2(m_physDevice, &properties2);
+
+            m_minImportedHostPointerAlignment = externalMemoryHostProperties.minImportedHostPointerAlignment;
+        }
+
+        initPipelineCache();
+
+        m_computeQueue = std::make_unique<Queue>(m_device, m_queueFamilyIndex, enabledFeatures12.timelineSemaphore);
+        if (m_transferQueueFamilyIndex != ~0u)
+            m_transferQueue = std::make_unique<Queue>(m_device, m_transferQueueFamilyIndex, true);
+        const VkMemoryAllocateFlags allocateFlags = m_bufferDeviceAddress ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0u;
+        m_allocator = std::make_unique<MemoryAllocator>(m_physDevice, m_device, allocateFlags, externalMemoryHost);
+        m_stagingPool = std::make_unique<StagingPool>(m_device, m_allocator.get(), queueFamilyIndices());
+    }
+}
+
+Device::~Device()
+{
+    m_computeQueue.reset();
+    m_transferQueue.reset();
+    m_stagingPool.reset();
+    m_allocator.reset();
+
+    if (m_pipelineCache)
+    {
+        savePipelineCache();
+        vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+    }
+
+    if (m_device)
+        vkDestroyDevice(m_device, nullptr);
+}
+
+Device::Device(Device &&rhs)
+    : m_instance(std::exchange(rhs.m_instance, nullptr))
+    , m_physDevice(std::exchange(rhs.m_physDevice, VK_NULL_HANDLE))
+    , m_properties(rhs.m_properties)
+    , m_subgroupProperties(rhs.m_subgroupProperties)
+    , m_subgroupSizeControlProperties(rhs.m_subgroupSizeControlProperties)
+    , m_queueFamilyIndex(std::exchange(rhs.m_queueFamilyIndex, ~0u))
+    , m_transferQueueFamilyIndex(std::exchange(rhs.m_transferQueueFamilyIndex, ~0u))
+    , m_timestampValidBits(std::exchange(rhs.m_timestampValidBits, 0))
+    , m_device(std::exchange(rhs.m_device, VK_NULL_HANDLE))
+    , m_pipelineCache(std::exchange(rhs.m_pipelineCache, VK_NULL_HANDLE))
+    , m_bufferDeviceAddress(std::exchange(rhs.m_bufferDeviceAddress, false))
+    , m_pipelineStatistics(std::exchange(rhs.m_pipelineStatistics, false))
+    , m_subgroupSizeControl(std::exchange(rhs.m_subgroupSizeControl, false))
+    , m_computeFullSubgroups(std::exchange(rhs.m_computeFullSubgroups, false))
+    , m_synchronization2(std::exchange(rhs.m_synchronization2, false))
+    , m_maxPushDescriptors(std::exchange(rhs.m_maxPushDescriptors, 0))
+    , m_cmdPushDescriptorSet(std::exchange(rhs.m_cmdPushDescriptorSet, nullptr))
+    , m_minImportedHostPointerAlignment(std::exchange(rhs.m_minImportedHostPointerAlignment, 0))
+    , m_computeQueue(std::move(rhs.m_computeQueue))
+    , m_transferQueue(std::move(rhs.m_transferQueue))
+    , m_allocator(std::move(rhs.m_allocator))
+    , m_stagingPool(std::move(rhs.m_stagingPool))
+{
+}
+
+Device &Device::operator=(Device &&rhs)
+{
+    Device temp(std::move(rhs));
+    swap(*this, temp);
+    return *this;
+}
+
+bool Device::supportsSubgroupOperations(VkSubgroupFeatureFlags operations) const
+{
+    return (m_subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+           (m_subgroupProperties.supportedOperations & operations) == operations;
+}
+
+std::vector<std::uint32_t> Device::queueFamilyIndices() const
+{
+    std::vector<std::uint32_t> queueFamilyIndices{m_queueFamilyIndex};
+    if (m_transferQueueFamilyIndex != ~0u)
+        queueFamilyIndices.push_back(m_transferQueueFamilyIndex);
+    return queueFamilyIndices;
+}
+
+std::uint32_t Device::findHostVisibleMemory(VkDeviceSize size) const
+{
+    return m_allocator->findMemoryType(~0u, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                       size);
+}
+
+std::filesystem::path Device::pipelineCachePath() const
+{
+    std::filesystem::path directory;
+    if (const auto *path = std::getenv("VC_PIPELINE_CACHE_DIR"))
+        directory = path;
+    else if (const auto *path = std::getenv("XDG_CACHE_HOME"))
+        directory = std::filesystem::path(path) / "vc";
+    else if (const auto *path = std::getenv("HOME"))
+        directory = std::filesystem::path(path) / ".cache" / "vc";
+    else
+        directory = std::filesystem::temp_directory_path() / "vc";
+
+    // one file per driver build, the cache UUID changes whenever the driver can't reuse old binaries
+    std::string name = "pipeline-cache-";
+    for (auto byte : m_properties.pipelineCacheUUID)
+    {
+        char hex[3];
+        std::snprintf(hex, sizeof(hex), "%02x", byte);
+        name += hex;
+    }
+    name += ".bin";
+
+    return directory / name;
+}
+
+void Device::initPipelineCache()
+{
+    auto data = readFile(pipelineCachePath()).value_or(std::vector<std::byte>{});
+
+    // drivers are supposed to reject incompatible data themselves, but not all of them do
+    VkPipelineCacheHeaderVersionOne header{};
+    if (data.size() >= sizeof(header))
+        std::memcpy(&header, data.data(), sizeof(header));
+    const bool valid = data.size() >= sizeof(header) && header.headerSize >= sizeof(header) &&
+                       header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                       header.vendorID == m_properties.vendorID && header.deviceID == m_properties.deviceID &&
+                       std::ranges::equal(header.pipelineCacheUUID, m_properties.pipelineCacheUUID);
+    if (!valid)
+        data.clear();
+
+    const VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+                                                               .pNext = nullptr,
+                                                               .flags = 0,
+                                                               .initialDataSize = data.size(),
+                                                               .pInitialData = data.data()};
+    VK_CHECK(vkCreatePipelineCache(m_device, &pipelineCacheCreateInfo, nullptr, &m_pipelineCache));
+}
+
+void Device::savePipelineCache() const
+{
+    std::size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(m_device, m_pipelineCache, &size, nullptr));
+    std::vector<std::byte> data(size);
+    VK_CHECK(vkGetPipelineCacheData(m_device, m_pipelineCache, &size, data.data()));
+    data.resize(size);
+
+    // write to a temporary file of our own first, so concurrent processes never see a partial cache and the rename
+    // replaces it atomically with one complete version
+    const auto path = pipelineCachePath();
+    auto tempPath = path;
+    // devices of the same driver in one process share the cache path too
+    tempPath += "." + std::to_string(getpid()) + "." + std::to_string(reinterpret_cast<std::uintptr_t>(this)) + ".tmp";
+
+    std::error_code error;
+    std::filesystem::create_directories(path.parent_path(), error);
+    if (!writeFile(tempPath, data))
+    {
+        std::filesystem::remove(tempPath, error);
+        return;
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error)
+        std::filesystem::remove(tempPath, error);
+}
+
+void Device::execute(const std::function<void(VkCommandBuffer)> &record) const
+{
+    submit(record).wait();
+}
+
+Ticket Device::submit(const std::function<void(VkCommandBuffer)> &record) const
+{
+    return m_computeQueue->submit(record);
+}
+
+void Device::pushDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout,
+                               std::span<const VkWriteDescriptorSet> writeDescriptorSets) const
+{
+    m_cmdPushDescriptorSet(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0,
+                           static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data());
+}
+
+bool Ticket::isReady() const
+{
+    return !m_queue || m_queue->isComplete(m_serial);
+}
+
+void Ticket::wait() const
+{
+    if (m_queue)
+        m_queue->wait(m_serial);
+}
+
+bool Ticket::wait(std::chrono::nanoseconds timeout) const
+{
+    return !m_queue || m_queue->wait(m_serial, timeout);
+}
+
+Queue::Queue(VkDevice device, std::uint32_t familyIndex, bool timelineSemaphore, std::uint32_t ringSize)
+    : m_device(device)
+    , m_familyIndex(familyIndex)
+    , m_slots(ringSize)
+{
+    vkGetDeviceQueue(m_device, m_familyIndex, 0, &m_queue);
+
+    const VkCommandPoolCreateInfo commandPoolCreateInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                                                           .pNext = nullptr,
+                                                           .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                                                           .queueFamilyIndex = m_familyIndex};
+    VK_CHECK(vkCreateCommandPool(m_device, &commandPoolCreateInfo, nullptr, &m_commandPool));
+
+    std::vector<VkCommandBuffer> commandBuffers(ringSize);
+    const VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .commandPool = m_commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = ringSize,
+    };
+    VK_CHECK(vkAllocateCommandBuffers(m_device, &commandBufferAllocateInfo, commandBuffers.data()));
+
+    const VkFenceCreateInfo fenceCreateInfo = {.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, .pNext = nullptr, .flags = 0};
+    for (std::uint32_t i = 0; i < ringSize; ++i)
+    {
+        m_slots[i].commandBuffer = commandBuffers[i];
+        VK_CHECK(vkCreateFence(m_device, &fenceCreateInfo, nullptr, &m_slots[i].fence));
+    }
+
+    if (timelineSemaphore)
+    {
+        const VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {.sType =
+                                                                       VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                                                                   .pNext = nullptr,
+                                                                   .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                                                                   .initialValue = 0};
+        const VkSemaphoreCreateInfo semaphoreCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &semaphoreTypeCreateInfo, .flags = 0};
+        VK_CHECK(vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_timeline));
+    }
+}
+
+Queue::~Queue()
+{
+    waitIdle();
+
+    for (const auto &slot : m_slots)
+    {
+        vkDestroyFence(m_device, slot.fence, nullptr);
+        vkFreeCommandBuffers(m_device, m_commandPool, 1, &slot.commandBuffer);
+    }
+
+    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+
+    if (m_timeline)
+        vkDestroySemaphore(m_device, m_timeline, nullptr);
+}
+
+Ticket Queue::submit(const std::function<void(VkCommandBuffer)> &record)
+{
+    const auto serial = acquireSlot();
+    const auto commandBuffer = slot(serial).commandBuffer;
+
+    VK_CHECK(vkResetCommandBuffer(commandBuffer, 0));
+    const VkCommandBufferBeginInfo commandBufferBeginInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                                             .pNext = nullptr,
+                                                             .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                                                             .pInheritanceInfo = nullptr};
+    VK_CHECK(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+    record(commandBuffer);
+    VK_CHECK(vkEndCommandBuffer(commandBuffer));
+
+    return submitSlot(serial, commandBuffer);
+}
+
+Ticket Queue::submit(VkCommandBuffer commandBuffer)
+{
+    return submitSlot(acquireSlot(), commandBuffer);
+}
+
+std::uint64_t Queue::acquireSlot()
+{
+    const auto serial = m_nextSerial++;
+    auto &submission = slot(serial);
+
+    // recycle the slot once its previous submission has retired
+    if (submission.serial != 0)
+    {
+        VK_CHECK(vkWaitForFences(m_device, 1, &submission.fence, VK_TRUE, UINT64_MAX));
+        VK_CHECK(vkResetFences(m_device, 1, &submission.fence));
+    }
+    submission.serial = serial;
+
+    return serial;
+}
+
+void Queue::addWait(const Ticket &ticket)
+{
+    // submissions on the same queue are already ordered
+    if (!ticket || ticket.m_queue == this)
+        return;
+
+    m_waitSemaphores.push_back(ticket.m_queue->m_timeline);
+    m_waitValues.push_back(ticket.m_serial);
+}
+
+Ticket Queue::submitSlot(std::uint64_t serial, VkCommandBuffer commandBuffer)
+{
+    const std::vector<VkPipelineStageFlags> waitStages(m_waitSemaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    const VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .waitSemaphoreValueCount = static_cast<uint32_t>(m_waitValues.size()),
+        .pWaitSemaphoreValues = m_waitValues.data(),
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &serial};
+    const VkSubmitInfo submitInfo = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                                     .pNext = m_timeline ? &timelineSemaphoreSubmitInfo : nullptr,
+                                     .waitSemaphoreCount = static_cast<uint32_t>(m_waitSemaphores.size()),
+                                     .pWaitSemaphores = m_waitSemaphores.data(),
+                                     .pWaitDstStageMask = waitStages.data(),
+                                     .commandBufferCount = 1,
+                                     .pCommandBuffers = &commandBuffer,
+                                     .signalSemaphoreCount = m_timeline ? 1u : 0u,
+                                     .pSignalSemaphores = &m_timeline};
+    VK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, slot(serial).fence));
+
+    m_waitSemaphores.clear();
+    m_waitValues.clear();
+
+    return Ticket(this, serial);
+}
+
+bool Queue::isComplete(std::uint64_t serial) const
+{
+    // a slot that has moved on to a later submission was waited on before being reused
+    const auto &submission = slot(serial);
+    if (submission.serial != serial)
+        return true;
+
+    const auto status = vkGetFenceStatus(m_device, submission.fence);
+    if (status == VK_NOT_READY)
+        return false;
+    VK_CHECK(status);
+    return true;
+}
+
+void Queue::wait(std::uint64_t serial) const
+{
+    const auto &submission = slot(serial);
+    if (submission.serial == serial)
+        VK_CHECK(vkWaitForFences(m_device, 1, &submission.fence, VK_TRUE, UINT64_MAX));
+}
+
+bool Queue::wait(std::uint64_t serial, std::chrono::nanoseconds timeout) const
+{
+    const auto &submission = slot(serial);
+    if (submission.serial != serial)
+        return true;
+
+    const auto status = vkWaitForFences(m_device, 1, &submission.fence, VK_TRUE, timeout.count());
+    if (status == VK_TIMEOUT)
+        return false;
+    VK_CHECK(status);
+    return true;
+}
+
+void Queue::waitIdle() const
+{
+    VK_CHECK(vkQueueWaitIdle(m_queue));
+}
+
+MemoryAllocator::MemoryAllocator(VkPhysicalDevice physDevice, VkDevice device, VkMemoryAllocateFlags allocateFlags,
+                                 bool externalMemoryHost)
+    : m_device(device)
+    , m_allocateFlags(allocateFlags)
+{
+    vkGetPhysicalDeviceMemoryProperties(physDevice, &m_memoryProperties);
+    if (externalMemoryHost)
+        m_getMemoryHostPointerProperties = reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(
+            vkGetDeviceProcAddr(m_device, "vkGetMemoryHostPointerPropertiesEXT"));
+
+    m_pools.resize(m_memoryProperties.memoryTypeCount);
+    for (std::uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+    {
+        const auto &heap = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[i].heapIndex];
+        // keep blocks small relative to the heap so that small heaps (e.g. BAR memory) aren't exhausted by one block
+        const auto blockSize = std::max(std::min(DefaultBlockSize, std::bit_floor(heap.size / 8)),
+                                        VkDeviceSize(1) << MinOrder);
+        m_pools[i].maxOrder = std::countr_zero(blockSize);
+    }
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+    for (auto &pool : m_pools)
+    {
+        for (auto &block : pool.blocks)
+            releaseBlock(block);
+    }
+}
+
+std::uint32_t MemoryAllocator::findMemoryType(std::uint32_t typeBits, VkMemoryPropertyFlags properties,
+                                              VkDeviceSize size) const
+{
+    for (std::uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+    {
+        if (!(typeBits & (1u << i)))
+            continue;
+        const VkMemoryType &memoryType = m_memoryProperties.memoryTypes[i];
+        if ((memoryType.propertyFlags & properties) == properties)
+        {
+            const auto &heap = m_memoryProperties.memoryHeaps[memoryType.heapIndex];
+            if (size <= heap.size)
+                return i;
+        }
+    }
+
+    return ~0u;
+}
+
+std::optional<Allocation> MemoryAllocator::allocate(const VkMemoryRequirements &requirements,
+                                                    VkMemoryPropertyFlags properties)
+{
+    const auto memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties, requirements.size);
+    if (memoryTypeIndex == ~0u)
+        return std::nullopt;
+
+    auto &pool = m_pools[memoryTypeIndex];
+
+    // buddy blocks are aligned to their own size, so rounding up to the alignment also takes care of it
+    const auto allocationSize =
+        std::bit_ceil(std::max({requirements.size, requirements.alignment, VkDeviceSize(1) << MinOrder}));
+    const std::uint32_t order = std::countr_zero(allocationSize);
+    if (order >= pool.maxOrder)
+        return allocateDedicated(requirements.size, memoryTypeIndex);
+
+    const auto allocateFromBlock = [order](Block &block) -> std::optional<VkDeviceSize> {
+        auto freeOrder = order;
+        while (freeOrder < block.freeLists.size() && block.freeLists[freeOrder].empty())
+            ++freeOrder;
+        if (freeOrder == block.freeLists.size())
+            return std::nullopt;
+
+        auto &freeList = block.freeLists[freeOrder];
+        const auto offset = *freeList.begin();
+        freeList.erase(freeList.begin());
+
+        // split until we get down to the requested size class, returning the upper halves to the free lists
+        while (freeOrder > order)
+        {
+            --freeOrder;
+            block.freeLists[freeOrder].insert(offset + (VkDeviceSize(1) << freeOrder));
+        }
+
+        ++block.allocationCount;
+        return offset;
+    };
+
+    for (std::size_t i = 0; i < pool.blocks.size(); ++i)
+    {
+        auto &block = pool.blocks[i];
+        if (!block.memory)
+            continue;
+        if (const auto offset = allocateFromBlock(block); offset.has_value())
+        {
+            return Allocation{.memory = block.memory,
+                              .offset = *offset,
+                              .size = allocationSize,
+                              .mapped = block.mapped ? block.mapped + *offset : nullptr,
+                              .memoryTypeIndex = memoryTypeIndex,
+                              .blockIndex = static_cast<std::uint32_t>(i)};
+        }
+    }
+
+    // no room in the existing blocks, reuse a released slot or append a new block
+    auto it = std::ranges::find_if(pool.blocks, [](const Block &block) { return !block.memory; });
+    if (it == pool.blocks.end())
+        it = pool.blocks.insert(it, Block{});
+    if (!initBlock(*it, memoryTypeIndex, pool.maxOrder))
+        return std::nullopt;
+
+    const auto offset = allocateFromBlock(*it);
+    return Allocation{.memory = it->memory,
+                      .offset = *offset,
+                      .size = allocationSize,
+                      .mapped = it->mapped ? it->mapped + *offset : nullptr,
+                      .memoryTypeIndex = memoryTypeIndex,
+                      .blockIndex = static_cast<std::uint32_t>(std::distance(pool.blocks.begin(), it))};
+}
+
+void MemoryAllocator::free(const Allocation &allocation)
+{
+    if (allocation.blockIndex == ~0u)
+    {
+        // dedicated allocation, implicitly unmapped by vkFreeMemory
+        vkFreeMemory(m_device, allocation.memory, nullptr);
+        return;
+    }
+
+    auto &pool = m_pools[allocation.memoryTypeIndex];
+    auto &block = pool.blocks[allocation.blockIndex];
+
+    // merge with the buddy for as long as it's free
+    auto offset = allocation.offset;
+    std::uint32_t order = std::countr_zero(allocation.size);
+    while (order < pool.maxOrder)
+    {
+        auto &freeList = block.freeLists[order];
+        auto it = freeList.find(offset ^ (VkDeviceSize(1) << order));
+        if (it == freeList.end())
+            break;
+        freeList.erase(it);
+        offset &= ~(VkDeviceSize(1) << order);
+        ++order;
+    }
+    block.freeLists[order].insert(offset);
+
+    // give empty blocks back to the driver, but keep one around to avoid thrashing
+    if (--block.allocationCount == 0)
+    {
+        const auto liveBlocks =
+            std::ranges::count_if(pool.blocks, [](const Block &other) { return other.memory != VK_NULL_HANDLE; });
+        if (liveBlocks > 1)
+            releaseBlock(block);
+    }
+}
+
+std::optional<Allocation> MemoryAllocator::allocateDedicated(VkDeviceSize size, std::uint32_t memoryTypeIndex)
+{
+    Allocation allocation{.size = size, .memoryTypeIndex = memoryTypeIndex};
+
+    const VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+                                                               .pNext = nullptr,
+                                                               .flags = m_allocateFlags,
+                                                               .deviceMask = 0};
+    const VkMemoryAllocateInfo memoryAllocateInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                                     .pNext = m_allocateFlags ? &memoryAllocateFlagsInfo : nullptr,
+                                                     .allocationSize = size,
+                                                     .memoryTypeIndex = memoryTypeIndex};
+    if (vkAllocateMemory(m_device, &memoryAllocateInfo, nullptr, &allocation.memory) != VK_SUCCESS)
+        return std::nullopt;
+
+    if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        VK_CHECK(vkMapMemory(m_device, allocation.memory, 0, VK_WHOLE_SIZE, 0,
+                             reinterpret_cast<void **>(&allocation.mapped)));
+
+    return allocation;
+}
+
+std::optional<Allocation> MemoryAllocator::importHostMemory(void *pointer, VkDeviceSize size, std::uint32_t typeBits)
+{
+    if (!m_getMemoryHostPointerProperties)
+        return std::nullopt;
+
+    VkMemoryHostPointerPropertiesEXT hostPointerProperties = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT, .pNext = nullptr, .memoryTypeBits = 0};
+    if (m_getMemoryHostPointerProperties(m_device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pointer,
+                                         &hostPointerProperties) != VK_SUCCESS)
+        return std::nullopt;
+
+    // coherent so that the host side needs no flushes, same as the memory of other host-visible buffers
+    const auto memoryTypeIndex =
+        findMemoryType(typeBits & hostPointerProperties.memoryTypeBits,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, size);
+    if (memoryTypeIndex == ~0u)
+        return std::nullopt;
+
+    const VkImportMemoryHostPointerInfoEXT importMemoryHostPointerInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+        .pNext = nullptr,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+        .pHostPointer = pointer};
+    const VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+                                                               .pNext = &importMemoryHostPointerInfo,
+                                                               .flags = m_allocateFlags,
+                                                               .deviceMask = 0};
+    const VkMemoryAllocateInfo memoryAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = m_allocateFlags ? static_cast<const void *>(&memoryAllocateFlagsInfo) : &importMemoryHostPointerInfo,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex};
+
+    // a dedicated allocation as far as free() is concerned, the pointer itself serves as the mapping
+    Allocation allocation{
+        .size = size, .mapped = static_cast<std::byte *>(pointer), .memoryTypeIndex = memoryTypeIndex};
+    if (vkAllocateMemory(m_device, &memoryAllocateInfo, nullptr, &allocation.memory) != VK_SUCCESS)
+        return std::nullopt;
+
+    return allocation;
+}
+
+bool MemoryAllocator::initBlock(Block &block, std::uint32_t memoryTypeIndex, std::uint32_t maxOrder)
+{
+    const VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+                                                               .pNext = nullptr,
+                                                               .flags = m_allocateFlags,
+                                                               .deviceMask = 0};
+    const VkMemoryAllocateInfo memoryAllocateInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                                     .pNext = m_allocateFlags ? &memoryAllocateFlagsInfo : nullptr,
+                                                     .allocationSize = VkDeviceSize(1) << maxOrder,
+                                                     .memoryTypeIndex = memoryTypeIndex};
+    if (vkAllocateMemory(m_device, &memoryAllocateInfo, nullptr, &block.memory) != VK_SUCCESS)
+    {
+        block.memory = VK_NULL_HANDLE;
+        return false;
+    }
+
+    if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        VK_CHECK(vkMapMemory(m_device, block.memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&block.mapped)));
+
+    block.freeLists.assign(maxOrder + 1, {});
+    block.freeLists[maxOrder].insert(0);
+    block.allocationCount = 0;
+
+    return true;
+}
+
+void MemoryAllocator::releaseBlock(Block &block)
+{
+    if (block.memory)
+        vkFreeMemory(m_device, block.memory, nullptr);
+    block = Block{};
+}
+
+StagingPool::StagingPool(VkDevice device, MemoryAllocator *allocator, std::vector<std::uint32_t> queueFamilyIndices)
+    : m_device(device)
+    , m_allocator(allocator)
+    , m_queueFamilyIndices(std::move(queueFamilyIndices))
+{
+}
+
+StagingPool::~StagingPool()
+{
+    // the queues are idle (and gone) by now, so pending buffers are not waited on
+    for (const auto &[buffer, ticket] : m_pendingBuffers)
+        destroy(buffer);
+    for (const auto &buffer : m_freeBuffers)
+        destroy(buffer);
+}
+
+StagingBuffer StagingPool::acquire(VkDeviceSize size)
+{
+    // round up so that buffers can be reused for similarly sized transfers
+    size = std::bit_ceil(std::clamp(size, MinBufferSize, MaxBufferSize));
+
+    const auto takeFree = [&]() -> std::optional<StagingBuffer> {
+        for (auto it = m_pendingBuffers.begin(); it != m_pendingBuffers.end();)
+        {
+            if (it->second.isReady())
+            {
+                m_freeBuffers.push_back(it->first);
+                it = m_pendingBuffers.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        // smallest free buffer that fits
+        auto best = m_freeBuffers.end();
+        for (auto it = m_freeBuffers.begin(); it != m_freeBuffers.end(); ++it)
+        {
+            if (it->size >= size && (best == m_freeBuffers.end() || it->size < best->size))
+                best = it;
+        }
+        if (best == m_freeBuffers.end())
+            return std::nullopt;
+        const auto buffer = *best;
+        m_freeBuffers.erase(best);
+        return buffer;
+    };
+
+    if (const auto buffer = takeFree())
+        return *buffer;
+
+    // make room by dropping free buffers that are too small, then by waiting for the oldest pending ones
+    while (m_poolSize + size > MaxPoolSize && !m_freeBuffers.empty())
+    {
+        destroy(m_freeBuffers.back());
+        m_freeBuffers.pop_back();
+    }
+    while (m_poolSize + size > MaxPoolSize && !m_pendingBuffers.empty())
+    {
+        m_pendingBuffers.front().second.wait();
+        if (const auto buffer = takeFree())
+            return *buffer;
+        destroy(m_freeBuffers.back());
+        m_freeBuffers.pop_back();
+    }
+
+    return create(size);
+}
+
+void StagingPool::release(StagingBuffer buffer, Ticket ticket)
+{
+    if (ticket.isReady())
+        m_freeBuffers.push_back(buffer);
+    else
+        m_pendingBuffers.emplace_back(buffer, ticket);
+}
+
+StagingBuffer StagingPool::create(VkDeviceSize size)
+{
+    StagingBuffer buffer{.size = size};
+
+    const VkBufferCreateInfo bufferCreateInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                                 .pNext = nullptr,
+                                                 .flags = 0,
+                                                 .size = buffer.size,
+                                                 .usage =
+                                                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                 .sharingMode = m_queueFamilyIndices.size() > 1
+                                                                    ? VK_SHARING_MODE_CONCURRENT
+                                                                    : VK_SHARING_MODE_EXCLUSIVE,
+                                                 .queueFamilyIndexCount =
+                                                     static_cast<uint32_t>(m_queueFamilyIndices.size()),
+                                                 .pQueueFamilyIndices = m_queueFamilyIndices.data()};
+    VK_CHECK(vkCreateBuffer(m_device, &bufferCreateInfo, nullptr, &buffer.buffer));
+
+    VkMemoryRequirements memoryRequirements{};
+    vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memoryRequirements);
+
+    const auto allocation = m_allocator->allocate(
+        memoryRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (!allocation.has_value())
+    {
+        std::fprintf(stderr, "Failed to allocate %lu bytes of staging memory\n", buffer.size);
+        std::exit(EXIT_FAILURE);
+    }
+    buffer.allocation = *allocation;
+
+    VK_CHECK(vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset));
+
+    m_poolSize += buffer.size;
+
+    return buffer;
+}
+
+void StagingPool::destroy(const StagingBuffer &buffer)
+{
+    vkDestroyBuffer(m_device, buffer.buffer, nullptr);
+    m_allocator->free(buffer.allocation);
+    m_poolSize -= buffer.size;
+}
+
+Instance::Instance(const InstanceOptions &options)
+{
+    const VkApplicationInfo applicationInfo = {.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+                                               .pNext = nullptr,
+                                               .pApplicationName = options.applicationName.c_str(),
+                                               .applicationVersion = options.applicationVersion,
+                                               .pEngineName = "vc",
+                                               .engineVersion = 0,
+                                               .apiVersion = VK_API_VERSION_1_3};
+
+    std::vector<const char *> layers;
+    for (const auto &layer : options.layers)
+        layers.push_back(layer.c_str());
+
+    std::vector<const char *> extensions;
+    for (const auto &extension : options.extensions)
+        extensions.push_back(extension.c_str());
+    if (options.debugMessenger && std::ranges::find(options.extensions, VK_EXT_DEBUG_UTILS_EXTENSION_NAME) ==
+                                      options.extensions.end())
+        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    if (options.debugPrintf && std::ranges::find(options.extensions, VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME) ==
+                                   options.extensions.end())
+        extensions.push_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
+
+    // also chained into the instance create info to catch messages from vkCreateInstance and vkDestroyInstance
+    const VkDebugUtilsMessengerCreateInfoEXT debugUtilsMessengerCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
+        .pNext = nullptr,
+        .flags = 0,
+        .messageSeverity = options.debugMessageSeverities,
+        .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                       VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT,
+        .pfnUserCallback = debugMessengerCallback,
+        .pUserData = nullptr};
+    const void *next = options.debugMessenger ? &debugUtilsMessengerCreateInfo : nullptr;
+
+    const VkValidationFeatureEnableEXT enabledValidationFeature = VK_VALIDATION_FEATURE_ENABLE_DEBUG_PRINTF_EXT;
+    const VkValidationFeaturesEXT validationFeatures = {.sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT,
+                                                        .pNext = next,
+                                                        .enabledValidationFeatureCount = 1,
+                                                        .pEnabledValidationFeatures = &enabledValidationFeature,
+                                                        .disabledValidationFeatureCount = 0,
+                                                        .pDisabledValidationFeatures = nullptr};
+    if (options.debugPrintf)
+        next = &validationFeatures;
+
+    const VkInstanceCreateInfo instanceCreateInfo = {.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+                                                     .pNext = next,
+                                                     .flags = 0,
+                                                     .pApplicationInfo = &applicationInfo,
+                                                     .enabledLayerCount = static_cast<uint32_t>(layers.size()),
+                                                     .ppEnabledLayerNames = layers.data(),
+                                                     .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
+                                                     .ppEnabledExtensionNames = extensions.data()};
+
+    VK_CHECK(vkCreateInstance(&instanceCreateInfo, nullptr, &m_instance));
+
+    if (options.debugMessenger)
+    {
+        const auto createDebugUtilsMessenger = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(
+            vkGetInstanceProcAddr(m_instance, "vkCreateDebugUtilsMessengerEXT"));
+        VK_CHECK(createDebugUtilsMessenger(m_instance, &debugUtilsMessengerCreateInfo, nullptr, &m_debugMessenger));
+    }
+}
+
+Instance::~Instance()
+{
+    if (m_debugMessenger)
+    {
+        const auto destroyDebugUtilsMessenger = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(
+            vkGetInstanceProcAddr(m_instance, "vkDestroyDebugUtilsMessengerEXT"));
+        destroyDebugUtilsMessenger(m_instance, m_debugMessenger, nullptr);
+    }
+
+    if (m_instance)
+        vkDestroyInstance(m_instance, nullptr);
+}
+
+Instance::Instance(Instance &&rhs)
+    : m_instance(std::exchange(rhs.m_instance, VK_NULL_HANDLE))
+    , m_debugMessenger(std::exchange(rhs.m_debugMessenger, VK_NULL_HANDLE))
+{
+}
+
+Instance &Instance::operator=(Instance &&rhs)
+{
+    Instance temp(std::move(rhs));
+    swap(*this, temp);
+    return *this;
+}
+
+std::vector<Device> Instance::devices() const
+{
+    uint32_t physDeviceCount = 0;
+    VK_CHECK(vkEnumeratePhysicalDevices(m_instance, &physDeviceCount, nullptr));
+
+    std::vector<VkPhysicalDevice> physDevices(physDeviceCount);
+    VK_CHECK(vkEnumeratePhysicalDevices(m_instance, &physDeviceCount, physDevices.data()));
 
     std::vector<Device> devices;
     devices.reserve(physDevices.size());
@@ -640,4 +3684,84 @@ std::vector<Device> Instance::devices() const
     return devices;
 }
 
+std::vector<PhysicalDevice> Instance::physicalDevices() const
+{
+    uint32_t physDeviceCount = 0;
+    VK_CHECK(vkEnumeratePhysicalDevices(m_instance, &physDeviceCount, nullptr));
+
+    std::vector<VkPhysicalDevice> physDevices(physDeviceCount);
+    VK_CHECK(vkEnumeratePhysicalDevices(m_instance, &physDeviceCount, physDevices.data()));
+
+    std::vector<PhysicalDevice> physicalDevices;
+    physicalDevices.reserve(physDevices.size());
+    for (auto physDevice : physDevices)
+    {
+        auto &physicalDevice = physicalDevices.emplace_back();
+        physicalDevice.handle = physDevice;
+        vkGetPhysicalDeviceProperties(physDevice, &physicalDevice.properties);
+        vkGetPhysicalDeviceMemoryProperties(physDevice, &physicalDevice.memoryProperties);
+
+        physicalDevice.queueFamilies = queueFamilies(physDevice);
+    }
+    return physicalDevices;
+}
+
+std::optional<PhysicalDevice> Instance::selectBestDevice(const DeviceCriteria &criteria) const
+{
+    const auto typeRank = [&criteria](VkPhysicalDeviceType type) -> int {
+        switch (type)
+        {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return criteria.preferIntegrated ? 1 : 0;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return criteria.preferIntegrated ? 0 : 1;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return 3;
+        default:
+            return 4;
+        }
+    };
+
+    std::optional<PhysicalDevice> best;
+    for (auto &physicalDevice : physicalDevices())
+    {
+        if (!physicalDevice.hasCompute() || physicalDevice.properties.apiVersion < criteria.minApiVersion ||
+            physicalDevice.deviceLocalMemory() < criteria.minDeviceLocalMemory)
+            continue;
+        if (criteria.filter && !criteria.filter(physicalDevice))
+            continue;
+
+        if (best.has_value())
+        {
+            const auto rank = typeRank(physicalDevice.properties.deviceType);
+            const auto bestRank = typeRank(best->properties.deviceType);
+            if (rank > bestRank ||
+                (rank == bestRank && physicalDevice.deviceLocalMemory() <= best->deviceLocalMemory()))
+                continue;
+        }
+        best = std::move(physicalDevice);
+    }
+    return best;
+}
+
+bool PhysicalDevice::hasCompute() const
+{
+    return std::ranges::any_of(queueFamilies, [](const VkQueueFamilyProperties &properties) -> bool {
+        return properties.queueFlags & VK_QUEUE_COMPUTE_BIT;
+    });
+}
+
+VkDeviceSize PhysicalDevice::deviceLocalMemory() const
+{
+    VkDeviceSize size = 0;
+    for (std::uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+    {
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            size += memoryProperties.memoryHeaps[i].size;
+    }
+    return size;
+}
+
 } // namespace vc